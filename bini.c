@@ -1,5 +1,9 @@
-#define __USE_MINGW_ANSI_STDIO 0
+#define __USE_MINGW_ANSI_STDIO 1
+#if defined(__unix__) || defined(__APPLE__)
+#  define _POSIX_C_SOURCE 200112L  /* for server and watch modes */
+#endif
 #include <errno.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdint.h> /* Only for uint32_t */
 #include <stdlib.h>
@@ -7,9 +11,42 @@
 
 #define PROGRAM_NAME "bini"
 
-#include "trie.h"
 #include "common.h"
+#include "format.h"
 #include "getopt.h"
+#include "cache.h"   /* after getopt.h, for unistd.h */
+#include "reader.h"
+#include "schema.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
+#if defined(__unix__) || defined(__APPLE__)
+#  include "server.h"
+#endif
+#ifdef __linux__
+#  include "watch.h"
+#endif
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " [-s] [-C dir] [-i path] [-o path] [-t schema] [-T path] [<INI|INI]\n");
+    fprintf(f, "       " PROGRAM_NAME " -c|-r [-t schema] [-T path] [INI...]\n");
+    fprintf(f, "       " PROGRAM_NAME " -S socket [-t schema]\n");
+    fprintf(f, "       " PROGRAM_NAME " -w dir [-t schema] [-T path]\n");
+    fprintf(f, "  -c       only check inputs for errors, writing no output\n");
+    fprintf(f, "  -C dir   reuse and record outputs in a cache directory\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -i path  only reparse sections changed since the sidecar\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -r       only verify a round trip through unbini and back\n");
+    fprintf(f, "  -s       print conversion statistics to standard error\n");
+    fprintf(f, "  -S path  serve conversions on a Unix domain socket\n");
+    fprintf(f, "  -t path  parse values as the types declared in a schema\n");
+    fprintf(f, "  -T path  append trace events to a file\n");
+    fprintf(f, "  -V       print version information\n");
+    fprintf(f, "  -w dir   convert each NAME.txt.ini saved in dir to NAME.ini\n");
+}
 
 static int
 xisplainspace(int c)
@@ -26,126 +63,87 @@ xisspace(int c)
            c == '\r' || c == '\t' || c == '\v';
 }
 
-static void
-reverse(char *s)
-{
-    size_t i, len = strlen(s);
-    for (i = 0; i < len / 2; i++) {
-        int tmp = s[i];
-        s[i] = s[len - i - 1];
-        s[len - i - 1] = (char)tmp;
-    }
-}
-
-/* String intern table */
-
-struct string {
-    char *s;
-    struct string *parent;
-    long offset;
-};
-
-static long
-string_offset(struct string *s)
-{
-    long parent, offset;
-    if (s->offset != -1) {
-        offset = s->offset;
-    } else {
-        parent = string_offset(s->parent);
-        offset = parent + (long)strlen(s->parent->s) - (long)strlen(s->s);
-        if (offset > 65535)
-            fatal("too many strings");
-    }
-    return offset;
-}
-
-static struct string *
-strings_push(struct trie *t, char *str)
-{
-    struct string *s;
-    reverse(str);
-    s = trie_search(t, str);
-    if (!s) {
-        s = xmalloc(sizeof(*s));
-        s->s = str;
-        s->parent = 0;
-        s->offset = -1;
-        if (trie_insert(t, str, s))
-            fatal("out of memory");
-    }
-    reverse(str);
-    return s;
-}
+/* Statistics for -s
+ *
+ * The string metrics describe the table as built: how many strings
+ * were interned, how many are stored as the suffix of another rather
+ * than on their own, and how far the last string starts below the
+ * largest offset an entry can refer to.
+ */
 
-/* Child to be connected to next-visited string */
-static struct string *child = 0;
+static struct {
+    double start, read, parse, intern, finalize, write;
+    unsigned long sections, entries, values[4];
+    unsigned long strings, shared, saved, table, last;
+    int cache_hit;        /* nothing was converted, so nothing counted */
+    int incremental;      /* reports the sections reused from a sidecar */
+    int table_reused;     /* string metrics were taken from the old table */
+    unsigned long reused;
+} stats;
 
-static int
-compute_offset(const char *key, void *data, void *arg, int nsiblings)
+static void
+stats_sections(struct section *section)
 {
-    struct string *s = data;
-    long *offset = arg;
-    if (child)
-        child->parent = s;
-    if (nsiblings) {
-        /* Secondary string, connect it to the next visited node */
-        child = s;
-    } else {
-        /* Primary string, append it to the table */
-        if (*offset > 65535)
-            fatal("too many strings");
-        s->offset = *offset;
-        *offset += (long)strlen(key) + 1;
-        child = 0;
+    for (; section; section = section->next) {
+        struct entry *entry;
+        stats.sections++;
+        for (entry = section->entries; entry; entry = entry->next) {
+            struct value *value;
+            stats.entries++;
+            for (value = entry->values; value; value = value->next)
+                stats.values[value->type]++;
+        }
     }
-    return 0;
-}
-
-/* Compute string table offsets. */
-static long
-strings_finalize(struct trie *t)
-{
-    long offset = 0;
-    if (trie_visit(t, "", compute_offset, &offset))
-        fatal("out of memory");
-    return offset;
 }
 
 static int
-free_visitor(const char *key, void *data, void *arg, int nsiblings)
+stats_visit(const char *key, void *data, void *arg, int nchildren)
 {
+    unsigned long len = (unsigned long)((struct string *)data)->len + 1;
     (void)key;
     (void)arg;
-    (void)nsiblings;
-    free(data);
-    return 0;
-}
-
-static void
-strings_free(struct trie *t)
-{
-    trie_visit(t, "", free_visitor, 0);
-    trie_free(t);
-}
-
-static int
-write_visit(const char *key, void *data, void *arg, int nsiblings)
-{
-    FILE *out = arg;
-    struct string *s = data;
-    size_t len = strlen(s->s) + 1;
-    (void)key;
-    if (!nsiblings)
-        fwrite(s->s, len, 1, out);
+    stats.strings++;
+    if (nchildren) {
+        stats.shared++;
+        stats.saved += len;
+    } else {
+        stats.last = stats.table;
+        stats.table += len;
+    }
     return 0;
 }
 
 static void
-strings_write(struct trie *t, FILE *out)
+stats_report(struct trie *strings, unsigned long inlen)
 {
-    if (trie_visit(t, "", write_visit, out))
+    if (!stats.cache_hit && !stats.table_reused &&
+        trie_visit(strings, "", stats_visit, 0))
         fatal("out of memory");
+    stats_count("input_bytes", inlen);
+    stats_time("read", stats.read);
+    stats_time("parse", stats.parse);
+    stats_time("intern", stats.intern);
+    stats_time("finalize", stats.finalize);
+    stats_time("write", stats.write);
+    stats_time("total", stats_now() - stats.start);
+    stats_memory();
+    if (stats.cache_hit) {
+        stats_count("cache_hit", 1);
+        return;
+    }
+    if (stats.incremental)
+        stats_count("sections_reused", stats.reused);
+    stats_count("sections", stats.sections);
+    stats_count("entries", stats.entries);
+    stats_count("values_integer", stats.values[VALUE_INTEGER]);
+    stats_count("values_float", stats.values[VALUE_FLOAT]);
+    stats_count("values_string", stats.values[VALUE_STRING]);
+    stats_count("strings_unique", stats.strings);
+    stats_count("strings_shared", stats.shared);
+    stats_count("strings_saved_bytes", stats.saved);
+    stats_count("string_table_bytes", stats.table);
+    stats_count("string_table_headroom",
+                stats.last > 65535 ? 0 : 65535 - stats.last);
 }
 
 /* Parser stream */
@@ -153,8 +151,10 @@ strings_write(struct trie *t, FILE *out)
 struct parser {
     char *filename;
     long line;
-    char *p;
-    char *end;
+    const char *p;
+    const char *end;
+    jmp_buf *bail;  /* if set, errors return here rather than exiting */
+    struct section *sections;  /* parse_all() so far, to free on a bail */
 };
 
 static void
@@ -166,6 +166,8 @@ error(struct parser *p, const char *fmt, ...)
     vfprintf(stderr, fmt, ap);
     fputc('\n', stderr);
     va_end(ap);
+    if (p->bail)
+        longjmp(*p->bail, 1);
     exit(EXIT_FAILURE);
 }
 
@@ -174,7 +176,7 @@ get(struct parser *p)
 {
     int c = -1;
     if (p->p < p->end) {
-        c = *(unsigned char *)(p->p);
+        c = *(const unsigned char *)(p->p);
         if (!c)
             error(p, "invalid NUL byte");
         p->p++;
@@ -261,146 +263,292 @@ parse_simple(struct parser *p, int term)
         unget(p);
 }
 
-/* Process a string, removing quotes and null-terminating it.
+/* The strings used by the parsed structures are views directly into
+ * the slurped input buffer, which is never modified. Only a quoted
+ * string containing escaped quotes is unescaped into a scratch buffer,
+ * and copied once when it is interned.
  */
-static char *
-escape_string(char *beg, char *end)
+struct token {
+    const char *s;
+    size_t len;
+    int copy;  /* S is scratch storage */
+};
+
+/* Extract the string between BEG and END, removing quotes or trimming
+ * white space.
+ */
+static void
+escape_string(struct token *t, const char *beg, const char *end)
 {
+    static char *buf;
+    static size_t cap;
+
     if (*beg == '"') {
-        char *s;
+        /* Strip the quotes, then collapse each doubled quote if any */
         beg++;
-        for (s = beg; s < end; s++) {
-            if (*s == '"') {
-                memmove(s, s + 1, end - s);
-                end--;
+        end--;
+        t->copy = !!memchr(beg, '"', end - beg);
+        if (t->copy) {
+            const char *s;
+            char *d = scratch(&buf, &cap, end - beg);
+            for (s = beg, beg = d; s < end; s++) {
+                if (*s == '"')
+                    s++;
+                *d++ = *s;
             }
+            end = d;
         }
     } else {
-        while (xisspace(*beg))
+        while (beg < end && xisspace(*beg))
             beg++;
-        while (xisspace(end[-1]))
+        while (end > beg && xisspace(end[-1]))
             end--;
+        t->copy = 0;
     }
-    *end = 0;
-    return beg;
+    t->s = beg;
+    t->len = end - beg;
 }
 
-/* BINI structs
- *
- * The layout here does *not* much resemble their layout in BINI files.
- *
- * The strings used by these structures point directly into the slurped
- * input buffer, and those strings are escaped in place. Some care must
- * be taken not to write the null terminator too soon.
+#ifdef BINI_TRACE
+/* Interning time in milliseconds since the last call, which is
+ * reported on each parse span rather than as a span per string.
+ */
+static double
+trace_interned(void)
+{
+    static double last;
+    double ms = (stats.intern - last) * 1e3;
+    last = stats.intern;
+    return ms;
+}
+#endif
+
+/* Intern a string, charging the time to interning rather than parsing.
  */
+static struct string *
+intern(struct trie *strings, const struct token *t)
+{
+    struct string *string;
+    stats_lap(&stats.parse);
+    string = strings_push(strings, t->s, t->len, t->copy);
+    stats_lap(&stats.intern);
+    return string;
+}
 
-#define VALUE_INTEGER 1
-#define VALUE_FLOAT   2
-#define VALUE_STRING  3
-struct value {
-    struct value *next;
+static unsigned long
+float_bits(float x)
+{
     union {
-        long i;
         float f;
-        struct string *s;
-    } value;
-    int type;
-};
+        uint32_t i;
+    } conv;
+    conv.f = x;
+    return conv.i;
+}
 
-struct entry {
-    struct entry *next;
-    struct string *name;
-    struct value *values;
-    int nvalue;
-};
+/* The declared types, if any, from -t */
+static struct schema *schema;
 
-struct section {
-    struct section *next;
-    struct string *name;
-    struct entry *entries;
-    long nentry;
-    unsigned long size;
-};
+/* Return a token that strtol() or strtod() will read no further than.
+ * Both stop at the white space or delimiter following it, so it is
+ * only copied out and terminated when nothing follows it, or when it
+ * is empty and they would skip ahead to the next line.
+ */
+static const char *
+number_text(const struct parser *p, const struct token *t)
+{
+    static char *buf;
+    static size_t cap;
+    char *copy;
+    if (t->len && t->s + t->len != p->end)
+        return t->s;
+    copy = scratch(&buf, &cap, t->len + 1);
+    memcpy(copy, t->s, t->len);
+    copy[t->len] = 0;
+    return copy;
+}
 
-static struct value *
-parse_value(struct parser *p, struct trie *strings, int *nextc)
+/* Convert an unquoted token to the declared TYPE, or report that it
+ * can't be.
+ */
+static void
+parse_typed(struct parser *p, struct trie *strings, int type,
+            const struct token *t, struct value *value)
 {
-    int c;
-    char *beg, *end;
-    struct value *value;
+    long i;
+    float f;
+    char *numend;
+    const char *num;
+
+    value->type = type;
+    if (type == VALUE_STRING) {
+        value->value.s = intern(strings, t);
+        return;
+    }
 
-    value = xmalloc(sizeof(*value));
-    value->next = 0;
+    num = number_text(p, t);
+    errno = 0;
+    if (type == VALUE_INTEGER) {
+        i = strtol(num, &numend, 10);
+        if (!t->len || numend != num + t->len || (!i && errno))
+            error(p, "expected an integer, found '%.*s'", (int)t->len, t->s);
+        value->value.u = (unsigned long)i;
+    } else {
+        f = (float)strtod(num, &numend);
+        if (!t->len || numend != num + t->len || (!f && errno))
+            error(p, "expected a float, found '%.*s'", (int)t->len, t->s);
+        value->value.u = float_bits(f);
+    }
+}
+
+/* Parse a value as TYPE into VALUE, or classify it by trial if TYPE is
+ * zero.
+ */
+static void
+parse_value(struct parser *p, struct trie *strings, int type,
+            struct value *value, int *nextc)
+{
+    int c;
+    const char *beg, *end;
+    struct token t;
 
     beg = p->p;
     c = get(p);
     if (c == '"') {
         /* Must be a quoted string */
+        if (type && type != VALUE_STRING)
+            error(p, "expected %s, found a quoted string",
+                  type == VALUE_INTEGER ? "an integer" : "a float");
         parse_string(p);
         end = p->p;
         *nextc = get(p);
-        beg = escape_string(beg, end);
-        value->value.s = strings_push(strings, beg);
+        escape_string(&t, beg, end);
+        value->value.s = intern(strings, &t);
         value->type = VALUE_STRING;
-        return value;
+        return;
 
     } else if (c == '\r' || c == '\n' || c == ',') {
         error(p, "missing/empty value");
-        return 0;
 
     } else {
         long i;
         float f;
+        const char *num;
+        char *numend;
 
         /* Extract the token as if it were a simple string */
         parse_simple(p, ',');
         end = p->p;
+        escape_string(&t, beg, end);
+
+        /* Declared, so parsed as that type, with any error reported
+         * before the delimiter moves the parser to the next line
+         */
+        if (type) {
+            parse_typed(p, strings, type, &t, value);
+            *nextc = get(p);
+            return;
+        }
         *nextc = get(p);
-        beg = escape_string(beg, end);
 
         /* Negative zero? */
         if (end - beg == 2 && beg[0] == '-' && beg[1] == '0') {
-            value->value.f = -0.0f;
+            value->value.u = float_bits(-0.0f);
             value->type = VALUE_FLOAT;
-            return value;
+            return;
         }
 
-        /* Is it an integer? */
-        errno = 0;
-        i = strtol(beg, &end, 10);
-        if (!*end && (i || !errno)) {
-            value->value.i = i;
-            value->type = VALUE_INTEGER;
-            return value;
-        }
+        /* Only a token that strtol() or strtod() might accept is tried */
+        if (!t.len || strchr("+-.0123456789iInN", t.s[0])) {
+            num = number_text(p, &t);
 
-        /* Is it a float? */
-        errno = 0;
-        f = (float)strtod(beg, &end);
-        if (!*end && (f || !errno)) {
-            value->value.f = f;
-            value->type = VALUE_FLOAT;
-            return value;
+            /* Is it an integer? */
+            errno = 0;
+            i = strtol(num, &numend, 10);
+            if (numend == num + t.len && (i || !errno)) {
+                value->value.u = (unsigned long)i;
+                value->type = VALUE_INTEGER;
+                return;
+            }
+
+            /* Is it a float? */
+            errno = 0;
+            f = (float)strtod(num, &numend);
+            if (numend == num + t.len && (f || !errno)) {
+                value->value.u = float_bits(f);
+                value->type = VALUE_FLOAT;
+                return;
+            }
         }
 
         /* Must just be a simple string */
-        value->value.s = strings_push(strings, beg);
+        value->value.s = intern(strings, &t);
         value->type = VALUE_STRING;
-        return value;
     }
 }
 
-static struct entry *
-parse_entry(struct parser *p, struct trie *strings)
+/* Parse the values of an entry, as declared by RULE if not null.
+ */
+static void
+parse_values(struct parser *p, struct trie *strings, const struct rule *rule,
+             struct entry *entry)
 {
     int c;
-    char *beg, *end;
     struct value *value;
-    struct value *tail = 0;
+    struct value **link = &entry->values;
+
+    for (;;) {
+        int type = 0;
+        if (rule) {
+            type = schema_type(rule, entry->nvalue);
+            if (!type)
+                error(p, "expected at most %d value%s for '%.*s'",
+                      rule->ntypes, rule->ntypes == 1 ? "" : "s",
+                      (int)entry->name->len, entry->name->s);
+        }
+        /* Linked first, so that a bail can free it with the rest */
+        value = xmalloc(sizeof(*value));
+        value->next = 0;
+        *link = value;
+        link = &value->next;
+        parse_value(p, strings, type, value, &c);
+        if (++entry->nvalue > 255)
+            error(p, "too many values in one entry");
+
+        /* Check for more values */
+        if (c == '\n' || c == -1)
+            return;
+        if (c == ';') {
+            /* Can't unget the ';', so consume the comment */
+            for (c = get(p); c != -1 && c != '\n'; c = get(p))
+                ;
+            return;
+        }
+        if (c != ',')
+            error(p, "unexpected '%c', expected ','", c);
+
+        /* Comma found, skip ahead to next value */
+        if (!skip_blank(p))
+            error(p, "unexpected EOF, expected a value");
+    }
+}
+
+/* Parse an entry, storing it to LINK as soon as it exists. Returns null
+ * at the end of the section.
+ */
+static struct entry *
+parse_entry(struct parser *p, struct trie *strings, struct entry **link)
+{
+    int c;
+    long line;
+    const char *beg, *end;
+    struct token t;
+    const struct rule *rule = 0;
     struct entry *entry;
 
     if (!skip_space(p))
         return 0;
+    line = p->line;
 
     beg = p->p;
     c = get(p);
@@ -427,62 +575,48 @@ parse_entry(struct parser *p, struct trie *strings)
     if (c != '=')
         error(p, "unexpected '%c', expected '='", c);
 
-    /* With that resolved, escape the string which may clobber the '=' */
-    beg = escape_string(beg, end);
+    escape_string(&t, beg, end);
+    if (schema)
+        rule = schema_entry(schema, t.s, t.len);
     entry = xmalloc(sizeof(*entry));
     entry->next = 0;
-    entry->name = strings_push(strings, beg);
+    entry->name = intern(strings, &t);
     entry->values = 0;
     entry->nvalue = 0;
+    *link = entry;
 
-    if (!skip_blank(p))
-        return entry;
-
-    /* Get the first value */
-    c = get(p);
-    if (c == ',')
-        error(p, "unexpected ',', expected a value");
-    unget(p);
-    if (c == '\n' || c == ';')
-        return entry; /* No more values possible */
-
-    /* Comma was found, so get the rest of the values */
-    for (;;) {
-        value = parse_value(p, strings, &c);
-        if (!tail) {
-            entry->values = tail = value;
-        } else {
-            tail->next = value;
-            tail = tail->next;
-        }
-        if (++entry->nvalue > 255)
-            error(p, "too many values in one entry");
-
-        /* Check for more values */
-        if (c == '\n' || c == -1)
-            return entry;
-        if (c == ';') {
-            /* Can't unget the ';', so consume the comment */
-            for (c = get(p); c != -1 && c != '\n'; c = get(p))
-                ;
-            return entry;
-        }
-        if (c != ',')
-            error(p, "unexpected '%c', expected ','", c);
+    if (skip_blank(p)) {
+        /* Get the first value */
+        c = get(p);
+        if (c == ',')
+            error(p, "unexpected ',', expected a value");
+        unget(p);
+        if (c != '\n' && c != ';')  /* otherwise no values */
+            parse_values(p, strings, rule, entry);
+    }
 
-        /* Comma found, skip ahead to next value */
-        if (!skip_blank(p))
-            error(p, "unexpected EOF, expected a value");
+    if (rule && entry->nvalue < schema_minimum(rule)) {
+        p->line = line;  /* the values may have ended the line */
+        error(p, "expected %s%d value%s for '%.*s', found %d",
+              rule->repeat ? "at least " : "", schema_minimum(rule),
+              schema_minimum(rule) == 1 ? "" : "s",
+              (int)entry->name->len, entry->name->s, entry->nvalue);
     }
+    return entry;
 }
 
+/* Parse a section, storing it to LINK as soon as it exists, so that
+ * everything parsed is reachable when an error bails out. Returns null
+ * at EOF.
+ */
 static struct section *
-parse_section(struct parser *p, struct trie *strings)
+parse_section(struct parser *p, struct trie *strings, struct section **link)
 {
     int c;
-    char *beg, *end;
+    const char *beg, *end;
+    struct token t;
     struct entry *entry;
-    struct entry *tail = 0;
+    struct entry **tail;
     struct section *section;
 
     if (!skip_space(p))
@@ -511,23 +645,21 @@ parse_section(struct parser *p, struct trie *strings)
     if (c != ']')
         error(p, "unexpected '%c', expected ']'", c);
 
-    /* With ']' now consumed, escape the string */
-    beg = escape_string(beg, end);
+    escape_string(&t, beg, end);
+    if (schema)
+        schema_section(schema, t.s, t.len);
     section = xmalloc(sizeof(*section));
     section->next = 0;
-    section->name = strings_push(strings, beg);
+    section->name = intern(strings, &t);
     section->entries = 0;
     section->nentry = 0;
     section->size = 4;
+    *link = section;
 
     /* Parse entries */
-    while ((entry = parse_entry(p, strings))) {
-        if (!tail) {
-            section->entries = tail = entry;
-        } else {
-            tail->next = entry;
-            tail = tail->next;
-        }
+    for (tail = &section->entries;
+         (entry = parse_entry(p, strings, tail));
+         tail = &entry->next) {
         if (++section->nentry > 65535)
             error(p, "too many entries in one section");
         section->size += 3 + entry->nvalue * 5;
@@ -536,169 +668,1190 @@ parse_section(struct parser *p, struct trie *strings)
     return section;
 }
 
-static void
-store_u32(unsigned long x, FILE *f)
-{
-    fputc(x >>  0, f);
-    fputc(x >>  8, f);
-    fputc(x >> 16, f);
-    fputc(x >> 24, f);
-}
-
-static void
-store_u16(unsigned x, FILE *f)
-{
-    fputc(x >> 0, f);
-    fputc(x >> 8, f);
-}
+/* Incremental mode
+ *
+ * A sidecar file keeps the previous output along with, for each of its
+ * sections, a hash of the section's text, the location of its encoded
+ * body, and the string table offsets it references. On the next run the
+ * input is only scanned for section boundaries and hashed, and just the
+ * sections whose text changed are parsed. If the edited sections still
+ * reference exactly the same set of strings, the string table and all
+ * offsets are unchanged, so the new output is spliced together from the
+ * old bodies and the newly encoded ones. Otherwise everything is parsed
+ * and encoded from scratch. Either way the output is identical to a
+ * full conversion.
+ *
+ * The scanner mirrors the parser's grammar exactly, without decoding or
+ * modifying anything, so it finds the same boundaries and reports the
+ * same errors as a full parse. The sidecar format, in little endian, is:
+ *
+ *   magic "BSID", program version string, u32 outlen, output[outlen]
+ *   u32 nslice, nslice records of:
+ *     u32 hash[4], u32 body offset, u32 body size, u32 nref, u16 ref[nref]
+ *
+ * An invalid or stale sidecar is ignored.
+ */
 
-static unsigned long
-conv_f32(float x)
-{
-    union {
-        float f;
-        uint32_t i;
-    } conv;
-    conv.f = x;
-    return conv.i;
-}
+#define SIDECAR_MAGIC 0x44495342UL
 
-int
-main(int argc, char **argv)
+/* Advance the parser over an entry without decoding it, exactly like
+ * parse_entry(). Returns zero at the end of the section.
+ */
+static int
+skip_entry(struct parser *p)
 {
-    int option;
-    unsigned long inlen;
-    char *inbuf;
-    unsigned long outlen = 12;
-    FILE *in = stdin;
-    FILE *out = stdout;
-    struct section head = {0};
-    struct section *section;
-    struct section *tail = &head;
-    struct parser parser = {"stdin", 1, 0, 0};
-    struct trie *strings;
+    int c, nvalue = 0;
 
-    while ((option = getopt(argc, argv, "ho:V")) != -1) {
-        switch (option) {
-            case 'h':
-                usage(stdout);
-                exit(EXIT_SUCCESS);
-            case 'o':
-                out = fopen(optarg, "wb");
-                if (!out)
-                    fatal("%s: %s", strerror(errno), optarg);
-                break;
-            case 'V':
-                version();
-                exit(EXIT_SUCCESS);
-            default:
-                usage(stderr);
-                exit(EXIT_FAILURE);
-        }
+    if (!skip_space(p))
+        return 0;
+    c = get(p);
+    if (c == '[') {
+        unget(p);
+        return 0;
     }
 
-    /* Use argument rather than standard input */
-    if (argv[optind]) {
-        if (argv[optind + 1])
-            fatal("too many input arguments");
-        in = fopen(argv[optind], "rb");
-        if (!in)
-            fatal("%s: %s", strerror(errno), argv[optind]);
-        parser.filename = argv[optind];
-    }
+    if (c == '"')
+        parse_string(p);
+    else
+        parse_simple(p, '=');
+    if (!skip_blank(p))
+        error(p, "unexpected EOF in entry, expected '='");
+    c = get(p);
+    if (c != '=')
+        error(p, "unexpected '%c', expected '='", c);
 
-#ifdef _WIN32
-    {
-        int _setmode(int, int);
-        if (out == stdout)
-            _setmode(_fileno(stdout), 0x8000);
-        if (in == stdin)
-            _setmode(_fileno(stdin), 0x8000);
-    }
-#endif
+    if (!skip_blank(p))
+        return 1;
+    c = get(p);
+    if (c == ',')
+        error(p, "unexpected ',', expected a value");
+    unget(p);
+    if (c == '\n' || c == ';')
+        return 1;
 
-    strings = trie_create();
+    for (;;) {
+        c = get(p);
+        if (c == '"')
+            parse_string(p);
+        else if (c == '\r' || c == '\n' || c == ',')
+            error(p, "missing/empty value");
+        else
+            parse_simple(p, ',');
+        c = get(p);
+        if (++nvalue > 255)
+            error(p, "too many values in one entry");
 
-    /* Initialize the parser */
-    parser.p = inbuf = slurp(in, &inlen);
-    parser.end = inbuf + inlen;
+        if (c == '\n' || c == -1)
+            return 1;
+        if (c == ';') {
+            for (c = get(p); c != -1 && c != '\n'; c = get(p))
+                ;
+            return 1;
+        }
+        if (c != ',')
+            error(p, "unexpected '%c', expected ','", c);
+        if (!skip_blank(p))
+            error(p, "unexpected EOF, expected a value");
+    }
+}
 
-    /* Sanity check */
-    if (inlen >= 5 && !memcmp(inbuf, "BINI\x01", 5))
-        fatal("input is a BINI file, use unbini instead: aborting");
+/* Advance the parser over a section without decoding it, exactly like
+ * parse_section(). Returns zero at EOF.
+ */
+static int
+skip_section(struct parser *p)
+{
+    int c;
+    long nentry = 0;
 
-    /* Parse the input into sections */
-    for (;;) {
-        tail->next = parse_section(&parser, strings);
-        if (!tail->next)
-            break;
-        tail = tail->next;
-        outlen += tail->size;
+    if (!skip_space(p))
+        return 0;
+    c = get(p);
+    if (c != '[')
+        error(p, "unexpected '%c', expected '['", c);
+    if (!skip_space(p))
+        error(p, "unexpected end of file");
+    c = get(p);
+    if (c == '"')
+        parse_string(p);
+    else
+        parse_simple(p, ']');
+    if (!skip_space(p))
+        error(p, "unexpected end of file");
+    c = get(p);
+    if (c != ']')
+        error(p, "unexpected '%c', expected ']'", c);
+
+    while (skip_entry(p))
+        if (++nentry > 65535)
+            error(p, "too many entries in one section");
+    return 1;
+}
+
+struct slice {
+    const char *beg, *end;
+    long line;
+    unsigned long hash[4];
+    const unsigned char *record;  /* reused sidecar record, if any */
+    struct section *section;      /* otherwise, the parsed section */
+};
+
+/* Sidecar records indexed by text hash in an open addressing table */
+
+struct slot {
+    unsigned long hash[4];
+    const unsigned char *record;
+};
+
+struct sidecar {
+    unsigned char *buf;
+    const unsigned char *out;  /* previous output */
+    unsigned long outlen, stroff;
+    const unsigned char *records;
+    unsigned long nslice;
+    struct slot *index;
+    unsigned long mask;
+};
+
+static struct slot *
+slot_find(struct slot *table, unsigned long mask, const unsigned long h[4])
+{
+    unsigned long i = (h[0] ^ h[2]) & mask;
+    for (;; i = (i + 1) & mask) {
+        struct slot *s = table + i;
+        if (!s->record || !memcmp(s->hash, h, sizeof(s->hash)))
+            return s;
     }
+}
 
-    strings_finalize(strings);
+/* Return the end of a sidecar record, or null if it is invalid.
+ */
+static const unsigned char *
+record_check(const struct sidecar *sc, const unsigned char *p,
+             const unsigned char *end)
+{
+    unsigned long i, body, size, nref;
+    if (end - p < 28)
+        return 0;
+    body = parse_u32(p + 16);
+    size = parse_u32(p + 20);
+    nref = parse_u32(p + 24);
+    p += 28;
+    if (body < 12 || body > sc->stroff || size > sc->stroff - body)
+        return 0;
+    if (nref > (unsigned long)(end - p) / 2)
+        return 0;
+    for (i = 0; i < nref; i++, p += 2)
+        if ((p[0] | (unsigned long)p[1] << 8) >= sc->outlen - sc->stroff)
+            return 0;
+    return p;
+}
 
-    /* Write bini header */
+/* Load and index a sidecar. Returns non-zero if it is absent or invalid.
+ */
+static int
+sidecar_load(struct sidecar *sc, const char *path)
+{
+    const unsigned char *p, *end;
+    unsigned long i, len, size = 1;
+    FILE *f = fopen(path, "rb");
+
+    sc->buf = 0;
+    sc->index = 0;
+    if (!f)
+        return -1;
+    sc->buf = slurp(f, &len);
+    fclose(f);
+
+    p = sc->buf;
+    end = p + len;
+    if (len < 4 || parse_u32(p) != SIDECAR_MAGIC)
+        return -1;
+    p += 4;
+    if (!memchr(p, 0, end - p) || strcmp((char *)p, PROGRAM_VERSION))
+        return -1;
+    p += sizeof(PROGRAM_VERSION);
+    if (end - p < 4)
+        return -1;
+    sc->outlen = parse_u32(p);
+    sc->out = p += 4;
+    if (sc->outlen < 12 || sc->outlen > (unsigned long)(end - p) - 4)
+        return -1;
+    sc->stroff = parse_u32(sc->out + 8);
+    if (sc->stroff < 12 || sc->stroff > sc->outlen)
+        return -1;
+    if (sc->outlen > sc->stroff && sc->out[sc->outlen - 1])
+        return -1;
+    p += sc->outlen;
+    sc->nslice = parse_u32(p);
+    sc->records = p += 4;
+    if (sc->nslice > (unsigned long)(end - p) / 28)
+        return -1;
+
+    while (size < sc->nslice * 2)
+        size *= 2;
+    sc->mask = size - 1;
+    sc->index = xreallocarray(0, size, sizeof(*sc->index));
+    for (i = 0; i < size; i++)
+        sc->index[i].record = 0;
+
+    for (i = 0; i < sc->nslice; i++) {
+        int j;
+        unsigned long h[4];
+        const unsigned char *record = p;
+        struct slot *s;
+        if (!(p = record_check(sc, p, end)))
+            return -1;
+        for (j = 0; j < 4; j++)
+            h[j] = parse_u32(record + j * 4);
+        s = slot_find(sc->index, sc->mask, h);
+        memcpy(s->hash, h, sizeof(s->hash));
+        s->record = record;
+    }
+    return 0;
+}
+
+/* Mark the string offsets referenced by a sidecar record.
+ */
+static const unsigned char *
+record_mark(const unsigned char *p, unsigned char *used)
+{
+    unsigned long i, nref = parse_u32(p + 24);
+    for (p += 28, i = 0; i < nref; i++, p += 2)
+        used[p[0] | p[1] << 8] = 1;
+    return p;
+}
+
+/* Count a reused section body from the old output, as stats_sections()
+ * counts a parsed one.
+ */
+static void
+stats_body(const unsigned char *p, unsigned long size)
+{
+    const unsigned char *end = p + size;
+    unsigned long i, nentry;
+    if (size < 4)
+        return;
+    stats.sections++;
+    stats.reused++;
+    nentry = parse_u16(p + 2);
+    for (p += 4, i = 0; i < nentry && end - p >= 3; i++) {
+        int j, nvalue = p[2];
+        stats.entries++;
+        for (p += 3, j = 0; j < nvalue && end - p >= 5; j++, p += 5)
+            if (p[0] < 4)
+                stats.values[p[0]]++;
+    }
+}
+
+/* Measure a reused string table from the offsets referenced into it,
+ * as stats_visit() measures a new one from the interned strings.
+ */
+static void
+stats_table(const unsigned char *used, const char *text, unsigned long len)
+{
+    unsigned long i;
+    stats.table_reused = 1;
+    stats.table = len;
+    for (i = 0; i < len; i++) {
+        int start = !i || !text[i - 1];
+        if (start)
+            stats.last = i;
+        if (i < 65536 && used[i]) {
+            stats.strings++;
+            if (!start) {
+                stats.shared++;
+                stats.saved += (unsigned long)strlen(text + i) + 1;
+            }
+        }
+    }
+}
+
+/* Give a parsed string its offset in the old string table, or with
+ * ASSIGN zero only check that it is there.
+ */
+static int
+string_map(struct string *s, struct trie *old, const char *text,
+           unsigned char *used, int assign)
+{
+    static char *buf;
+    static size_t cap;
+    char *key = scratch(&buf, &cap, s->len + 1);
+    char *match;
+    memcpy(key, s->s, s->len);
+    key[s->len] = 0;
+    match = trie_search(old, key);
+    if (!match)
+        return -1;
+    used[match - text] = 1;
+    if (assign)
+        s->offset = match - text;
+    return 0;
+}
+
+static int
+section_map(struct section *section, struct trie *old, const char *text,
+            unsigned char *used, int assign)
+{
+    struct entry *entry;
+    struct value *value;
+    if (string_map(section->name, old, text, used, assign))
+        return -1;
+    for (entry = section->entries; entry; entry = entry->next) {
+        if (string_map(entry->name, old, text, used, assign))
+            return -1;
+        for (value = entry->values; value; value = value->next)
+            if (value->type == VALUE_STRING &&
+                string_map(value->value.s, old, text, used, assign))
+                return -1;
+    }
+    return 0;
+}
+
+/* Write the string offsets referenced by a section as a record tail.
+ */
+static void
+section_refs(struct section *section, FILE *f)
+{
+    unsigned long nref = 1;
+    struct entry *entry;
+    struct value *value;
+
+    for (entry = section->entries; entry; entry = entry->next)
+        for (nref++, value = entry->values; value; value = value->next)
+            nref += value->type == VALUE_STRING;
+    store_u32(nref, f);
+
+    store_u16(string_offset(section->name), f);
+    for (entry = section->entries; entry; entry = entry->next) {
+        store_u16(string_offset(entry->name), f);
+        for (value = entry->values; value; value = value->next)
+            if (value->type == VALUE_STRING)
+                store_u16(string_offset(value->value.s), f);
+    }
+}
+
+/* Write the output, reusing the old string table if STRINGS is null.
+ */
+static void
+write_slices(struct slice *slices, long nslice, struct sidecar *sc,
+             struct trie *strings, unsigned long stroff, FILE *out)
+{
+    long i;
     store_u32(0x494e4942UL, out);
     store_u32(0x00000001UL, out);
-    store_u32(outlen, out);
+    store_u32(stroff, out);
+    for (i = 0; i < nslice; i++) {
+        const unsigned char *r = slices[i].record;
+        if (r)
+            fwrite(sc->out + parse_u32(r + 16), parse_u32(r + 20), 1, out);
+        else
+            sections_write_structs(slices[i].section, out);
+    }
+    if (strings)
+        strings_write(strings, out);
+    else
+        fwrite(sc->out + sc->stroff, sc->outlen - sc->stroff, 1, out);
+}
 
-    /* Write all structs */
-    for (section = head.next; section; section = section->next) {
-        struct entry *entry;
+/* Convert the input using the sidecar at PATH, then update the sidecar.
+ */
+static void
+convert_incremental(struct parser *p, struct trie *strings, const char *path,
+                    FILE *out)
+{
+    static unsigned char oldused[65536], newused[65536];
+    long i, nslice = 0, cap = 0;
+    int reuse;
+    char *part;
+    unsigned long tablelen, stroff = 12;
+    struct slice *slices = 0;
+    struct sidecar sc;
+    FILE *f;
+
+    TRACE_BEGIN("parse");
+    stats.incremental = 1;
+    reuse = !sidecar_load(&sc, path);
+    if (sc.buf && !reuse)
+        fprintf(stderr, "warning: %s: ignoring invalid sidecar\n", path);
+
+    /* Find and hash every section */
+    while (skip_space(p)) {
+        struct slice *s;
+        if (nslice == cap) {
+            cap = cap ? cap * 2 : 256;
+            slices = xreallocarray(slices, cap, sizeof(*slices));
+        }
+        s = slices + nslice++;
+        s->beg = p->p;
+        s->line = p->line;
+        skip_section(p);
+        s->end = p->p;
+        cache_hash(schema ? schema->text : "", s->beg,
+                   (unsigned long)(s->end - s->beg), s->hash);
+        s->record = reuse ? slot_find(sc.index, sc.mask, s->hash)->record : 0;
+        s->section = 0;
+    }
 
-        /* Write section */
-        store_u16(string_offset(section->name), out);
-        store_u16(section->nentry, out);
+    /* Parse the changed sections */
+    for (i = 0; i < nslice; i++) {
+        if (!slices[i].record) {
+            struct parser sub = *p;
+            sub.line = slices[i].line;
+            sub.p = slices[i].beg;
+            sub.end = slices[i].end;
+            parse_section(&sub, strings, &slices[i].section);
+        }
+    }
 
-        for (entry = section->entries; entry; entry = entry->next) {
-            struct value *value;
+    /* The old string table is still valid if it holds exactly the
+     * strings referenced now.
+     */
+    if (reuse) {
+        const unsigned char *r = sc.records;
+        const char *text = (char *)sc.out + sc.stroff;
+        struct trie *old = trie_create();
+        if (!old)
+            fatal("out of memory");
+        memset(oldused, 0, sizeof(oldused));
+        memset(newused, 0, sizeof(newused));
+        for (i = 0; i < (long)sc.nslice; i++)
+            r = record_mark(r, oldused);
+        for (i = 0; i < 65536 && i < (long)(sc.outlen - sc.stroff); i++)
+            if (oldused[i] && trie_insert(old, text + i, (char *)text + i))
+                fatal("out of memory");
+        for (i = 0; reuse && i < nslice; i++) {
+            if (slices[i].record)
+                record_mark(slices[i].record, newused);
+            else if (section_map(slices[i].section, old, text, newused, 0))
+                reuse = 0;
+        }
+        if (reuse && memcmp(oldused, newused, sizeof(oldused)))
+            reuse = 0;
+        for (i = 0; reuse && i < nslice; i++)
+            if (slices[i].section)
+                section_map(slices[i].section, old, text, newused, 1);
+        if (reuse && stats_enabled)
+            stats_table(newused, text, sc.outlen - sc.stroff);
+        trie_free(old);
+    }
 
-            /* Write entry */
-            store_u16(string_offset(entry->name), out);
-            fputc(entry->nvalue, out);
-
-            for (value = entry->values; value; value = value->next) {
-                /* Write value */
-                fputc(value->type, out);
-                switch (value->type) {
-                    case 1:
-                        store_u32(value->value.i, out);
-                        break;
-                    case 2:
-                        store_u32(conv_f32(value->value.f), out);
-                        break;
-                    case 3:
-                        store_u32(string_offset(value->value.s), out);
-                        break;
-                }
+    /* Otherwise parse everything and build a new string table */
+    if (!reuse) {
+        for (i = 0; i < nslice; i++) {
+            if (slices[i].record) {
+                struct parser sub = *p;
+                sub.line = slices[i].line;
+                sub.p = slices[i].beg;
+                sub.end = slices[i].end;
+                parse_section(&sub, strings, &slices[i].section);
+                slices[i].record = 0;
             }
         }
     }
+    stats_lap(&stats.parse);
+    TRACE_END_ARG("parse", "intern_ms", trace_interned());
+
+    if (!reuse) {
+        TRACE_BEGIN("finalize");
+        tablelen = (unsigned long)strings_finalize(strings);
+        stats_lap(&stats.finalize);
+        TRACE_END("finalize");
+    } else {
+        tablelen = sc.outlen - sc.stroff;
+    }
 
-    /* Write string table */
-    strings_write(strings, out);
+    TRACE_BEGIN("write");
+    for (i = 0; i < nslice; i++) {
+        const unsigned char *r = slices[i].record;
+        stroff += r ? parse_u32(r + 20) : slices[i].section->size;
+    }
+    write_slices(slices, nslice, &sc, reuse ? 0 : strings, stroff, out);
+
+    /* Record the new sidecar, replacing the old one only when complete */
+    part = xmalloc(strlen(path) + 6);
+    sprintf(part, "%s.part", path);
+    f = fopen(part, "wb");
+    if (!f)
+        fatal("%s: %s", strerror(errno), part);
+    store_u32(SIDECAR_MAGIC, f);
+    fwrite(PROGRAM_VERSION, sizeof(PROGRAM_VERSION), 1, f);
+    store_u32(stroff + tablelen, f);
+    write_slices(slices, nslice, &sc, reuse ? 0 : strings, stroff, f);
+    store_u32(nslice, f);
+    for (stroff = 12, i = 0; i < nslice; i++) {
+        int j;
+        const unsigned char *r = slices[i].record;
+        for (j = 0; j < 4; j++)
+            store_u32(slices[i].hash[j], f);
+        store_u32(stroff, f);
+        if (r) {
+            unsigned long nref = parse_u32(r + 24);
+            fwrite(r + 20, 8 + nref * 2, 1, f);
+            stroff += parse_u32(r + 20);
+        } else {
+            store_u32(slices[i].section->size, f);
+            section_refs(slices[i].section, f);
+            stroff += slices[i].section->size;
+        }
+    }
+    if (fclose(f))
+        fatal("%s: could not write sidecar", part);
+    if (rename(part, path)) {
+        /* Some systems won't rename over an existing file */
+        remove(path);
+        if (rename(part, path))
+            fatal("%s: could not replace sidecar", path);
+    }
+    if (stats_enabled) {
+        fflush(out);
+        stats_lap(&stats.write);
+    }
+    TRACE_END("write");
+
+    for (i = 0; i < nslice; i++) {
+        const unsigned char *r = slices[i].record;
+        if (stats_enabled && r)
+            stats_body(sc.out + parse_u32(r + 16), parse_u32(r + 20));
+        else if (stats_enabled)
+            stats_sections(slices[i].section);
+        sections_free(slices[i].section);
+    }
+    free(slices);
+    free(part);
+    free(sc.index);
+    free(sc.buf);
+}
 
-    /* Cleanup */
-    section = head.next;
-    while (section) {
-        struct section *sdead = section;
-        struct entry *entry = section->entries;
-        while (entry) {
-            struct entry *edead = entry;
-            struct value *value = entry->values;
-            while (value) {
-                struct value *vdead = value;
-                value = value->next;
-                free(vdead);
+/* Parse every section, growing the list in the parser as it goes.
+ */
+static struct section *
+parse_all(struct parser *parser, struct trie *strings)
+{
+    struct section **tail = &parser->sections;
+    *tail = 0;
+    while (parse_section(parser, strings, tail))
+        tail = &(*tail)->next;
+    return parser->sections;
+}
+
+/* Parse all of the input and write it out as BINI.
+ */
+static void
+convert(struct parser *parser, struct trie *strings, FILE *out)
+{
+    struct section *sections;
+    TRACE_BEGIN("parse");
+    sections = parse_all(parser, strings);
+    stats_lap(&stats.parse);
+    TRACE_END_ARG("parse", "intern_ms", trace_interned());
+    TRACE_BEGIN("finalize");
+    strings_finalize(strings);
+    stats_lap(&stats.finalize);
+    TRACE_END("finalize");
+    TRACE_BEGIN("write");
+    sections_write(sections, strings, out);
+    if (stats_enabled) {
+        fflush(out);
+        stats_lap(&stats.write);
+        stats_sections(sections);
+    }
+    TRACE_END("write");
+    sections_free(sections);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/* Convert one request in server mode.
+ */
+static void
+convert_request(const char *name, char *buf, unsigned long len, FILE *out)
+{
+    struct parser parser = {0, 1, 0, 0, 0, 0};
+    struct trie *strings = trie_create();
+    if (!strings)
+        fatal("out of memory");
+    if (len >= 5 && !memcmp(buf, "BINI\x01", 5))
+        fatal("input is a BINI file, use unbini instead: aborting");
+    parser.filename = (char *)name;
+    parser.p = buf;
+    parser.end = buf + len;
+    convert(&parser, strings, out);
+}
+#endif
+
+#ifdef __linux__
+/* Convert NAME.txt.ini into NAME.ini beside it, for watch mode. The
+ * output is replaced only once it is complete.
+ */
+static void
+convert_path(const char *path)
+{
+    unsigned long len;
+    size_t base = strlen(path) - 8;
+    char *outpath = xmalloc(base + 5);
+    char *part = xmalloc(base + 10);
+    struct parser parser = {0, 1, 0, 0, 0, 0};
+    struct section *sections;
+    struct trie *strings = trie_create();
+    FILE *in, *out;
+
+    if (!strings)
+        fatal("out of memory");
+    memcpy(outpath, path, base);
+    strcpy(outpath + base, ".ini");
+    sprintf(part, "%s.part", outpath);
+
+    in = fopen(path, "rb");
+    if (!in)
+        fatal("%s: %s", strerror(errno), path);
+    TRACE_FILE_BEGIN(path);
+    TRACE_BEGIN("read");
+    parser.filename = (char *)path;
+    parser.p = slurp(in, &len);
+    parser.end = parser.p + len;
+    fclose(in);
+    TRACE_END("read");
+    if (len >= 5 && !memcmp(parser.p, "BINI\x01", 5))
+        fatal("%s: input is a BINI file, skipping", path);
+
+    /* Parse fully before touching the output */
+    TRACE_BEGIN("parse");
+    sections = parse_all(&parser, strings);
+    TRACE_END_ARG("parse", "intern_ms", trace_interned());
+    TRACE_BEGIN("finalize");
+    strings_finalize(strings);
+    TRACE_END("finalize");
+    TRACE_BEGIN("write");
+    out = fopen(part, "wb");
+    if (!out)
+        fatal("%s: %s", strerror(errno), part);
+    sections_write(sections, strings, out);
+    if (fclose(out) || rename(part, outpath))
+        fatal("%s: %s", strerror(errno), outpath);
+    TRACE_END("write");
+    TRACE_FILE_END(path, len);
+    printf("%s\n", outpath);
+}
+#endif
+
+/* Mirror compute_offset() to detect string table overflow without
+ * exiting. Secondary strings resolve to an offset inside the next
+ * primary string, so only the shortest one pending matters.
+ */
+struct table_check {
+    long offset;
+    long shortest;  /* length of the shortest pending secondary, or -1 */
+    int overflow;
+};
+
+static int
+check_visit(const char *key, void *data, void *arg, int nsiblings)
+{
+    struct table_check *c = arg;
+    long len = ((struct string *)data)->len;
+    (void)key;
+    if (nsiblings) {
+        if (c->shortest < 0 || len < c->shortest)
+            c->shortest = len;
+    } else {
+        if (c->offset > 65535)
+            c->overflow = 1;
+        if (c->shortest >= 0 && c->offset + len - c->shortest > 65535)
+            c->overflow = 1;
+        c->offset += len + 1;
+        c->shortest = -1;
+    }
+    return 0;
+}
+
+/* Would the string table overflow? Only a large input can do so.
+ */
+static int
+strings_overflow(struct trie *strings, unsigned long inlen)
+{
+    struct table_check c = {0, -1, 0};
+    if (inlen < 65535)
+        return 0;
+    if (trie_visit(strings, "", check_visit, &c))
+        fatal("out of memory");
+    return c.overflow;
+}
+
+/* Validate one input buffer without writing anything, reporting the
+ * same diagnostics as a conversion, then free it. Returns non-zero if
+ * invalid.
+ */
+static int
+check(char *buf, unsigned long len, char *filename)
+{
+    jmp_buf bail;
+    struct trie *volatile strings = 0;
+    struct parser parser = {0, 1, 0, 0, 0, 0};
+
+    parser.filename = filename;
+    parser.p = buf;
+    parser.end = buf + len;
+    parser.bail = &bail;
+    if (len >= 5 && !memcmp(buf, "BINI\x01", 5)) {
+        fprintf(stderr, PROGRAM_NAME ": input is a BINI file, use unbini "
+                "instead: aborting\n");
+        free(buf);
+        return -1;
+    }
+    if (setjmp(bail)) {
+        /* A schema fails values midway through a parse */
+        if (strings) {
+            sections_free(parser.sections);
+            strings_free(strings);
+        }
+        free(buf);
+        return -1;
+    }
+
+    /* Syntax only, without decoding or interning anything */
+    while (skip_section(&parser))
+        ;
+
+    /* The string table is no larger than the input, so only a large
+     * input can overflow it, and only then are the strings interned,
+     * unless values must be checked against a schema.
+     */
+    if (len >= 65535 || schema) {
+        int overflow;
+        struct section *sections;
+        strings = trie_create();
+        if (!strings)
+            fatal("out of memory");
+        parser.line = 1;
+        parser.p = buf;
+        TRACE_BEGIN("parse");
+        sections = parse_all(&parser, strings);
+        TRACE_END_ARG("parse", "intern_ms", trace_interned());
+        overflow = strings_overflow(strings, len);
+        sections_free(sections);
+        strings_free(strings);
+        if (overflow) {
+            fprintf(stderr, PROGRAM_NAME ": too many strings\n");
+            free(buf);
+            return -1;
+        }
+    }
+
+    free(buf);
+    return 0;
+}
+
+/* Round trip verification
+ *
+ * The input is encoded, decoded to text exactly as unbini would print
+ * it, and encoded again, all within this process. The two encodings
+ * must be identical.
+ */
+
+/* Encode INI text, returning the BINI file in a new buffer. Returns
+ * null after reporting an error.
+ */
+static unsigned char *
+encode(char *text, unsigned long len, char *filename, unsigned long *outlen)
+{
+    jmp_buf bail;
+    unsigned char *out;
+    struct section *sections;
+    struct trie *volatile strings = 0;
+    struct parser parser = {0, 1, 0, 0, 0, 0};
+    FILE *tmp;
+
+    /* Check the syntax first, though a schema may still fail a value.
+     * Whatever was parsed before a failure is reachable from the parser.
+     */
+    parser.filename = filename;
+    parser.p = text;
+    parser.end = text + len;
+    parser.bail = &bail;
+    if (setjmp(bail)) {
+        if (strings) {
+            sections_free(parser.sections);
+            strings_free(strings);
+        }
+        return 0;
+    }
+    while (skip_section(&parser))
+        ;
+
+    strings = trie_create();
+    if (!strings)
+        fatal("out of memory");
+    parser.line = 1;
+    parser.p = text;
+    TRACE_BEGIN("parse");
+    sections = parse_all(&parser, strings);
+    TRACE_END_ARG("parse", "intern_ms", trace_interned());
+    if (strings_overflow(strings, len)) {
+        fprintf(stderr, PROGRAM_NAME ": %s: too many strings\n", filename);
+        sections_free(sections);
+        strings_free(strings);
+        return 0;
+    }
+    tmp = tmpfile();
+    if (!tmp)
+        fatal("%s", strerror(errno));
+    TRACE_BEGIN("finalize");
+    strings_finalize(strings);
+    TRACE_END("finalize");
+    TRACE_BEGIN("write");
+    sections_write(sections, strings, tmp);
+    TRACE_END("write");
+    sections_free(sections);
+    strings_free(strings);
+
+    rewind(tmp);
+    out = slurp(tmp, outlen);
+    fclose(tmp);
+    return out;
+}
+
+/* Decode a BINI file to INI text like unbini, into a new buffer.
+ */
+static char *
+decode(const unsigned char *buf, unsigned long len, unsigned long *outlen)
+{
+    int e, nvalue, printed = 0;
+    unsigned section, nentry, name;
+    const unsigned char *values;
+    struct reader r;
+    char *text;
+    FILE *tmp = tmpfile();
+
+    if (!tmp)
+        fatal("%s", strerror(errno));
+    if (reader_init(&r, buf, len))
+        fatal("%s", r.err);
+    while ((e = reader_section(&r, &section, &nentry)) == 1) {
+        print_section(r.text + section, 0, printed++, tmp);
+        while ((e = reader_entry(&r, &name, &nvalue, &values)) == 1)
+            if (print_entry(&r, name, nvalue, values, 0, tmp))
+                fatal("%s", r.err);
+        if (e < 0)
+            break;
+    }
+    if (e < 0)
+        fatal("%s", r.err);
+
+    rewind(tmp);
+    text = (char *)slurp(tmp, outlen);
+    fclose(tmp);
+    return text;
+}
+
+static int
+value_equal(const struct reader *a, const unsigned char *v,
+            const struct reader *b, const unsigned char *w)
+{
+    if (v[0] != w[0])
+        return 0;
+    if (v[0] == VALUE_STRING)
+        return !strcmp((char *)a->text + parse_u32(v + 1),
+                       (char *)b->text + parse_u32(w + 1));
+    return !memcmp(v + 1, w + 1, 4);
+}
+
+/* Describe where two valid encodings first differ.
+ */
+static void
+report_difference(const char *filename, const unsigned char *x,
+                  unsigned long xlen, const unsigned char *y,
+                  unsigned long ylen)
+{
+    struct reader a, b;
+    unsigned sa, sb, na, nb;
+
+    reader_init(&a, x, xlen);
+    reader_init(&b, y, ylen);
+    for (;;) {
+        int ea = reader_section(&a, &sa, &na);
+        int eb = reader_section(&b, &sb, &nb);
+        if (ea != 1 || eb != 1) {
+            if (ea == eb)
+                break;
+            fprintf(stderr, PROGRAM_NAME ": %s: round trip changed the "
+                    "number of sections\n", filename);
+            return;
+        }
+        if (strcmp((char *)a.text + sa, (char *)b.text + sb) || na != nb) {
+            fprintf(stderr, PROGRAM_NAME ": %s: round trip changed [%s]\n",
+                    filename, (char *)a.text + sa);
+            return;
+        }
+        for (;;) {
+            int j, va, vb;
+            unsigned ka, kb;
+            const unsigned char *xa, *xb;
+            if (reader_entry(&a, &ka, &va, &xa) != 1 ||
+                reader_entry(&b, &kb, &vb, &xb) != 1)
+                break;
+            for (j = 0; va == vb && j < va; j++)
+                if (!value_equal(&a, xa + j * 5, &b, xb + j * 5))
+                    break;
+            if (strcmp((char *)a.text + ka, (char *)b.text + kb) ||
+                va != vb || j < va) {
+                fprintf(stderr, PROGRAM_NAME ": %s: round trip changed "
+                        "[%s] %s\n", filename, (char *)a.text + sa,
+                        (char *)a.text + ka);
+                return;
+            }
+        }
+    }
+    fprintf(stderr, PROGRAM_NAME ": %s: round trip changed the string "
+            "table\n", filename);
+}
+
+/* Verify that an input buffer survives a round trip through text
+ * unchanged, then free it. Returns non-zero after reporting a failure.
+ */
+static int
+verify(char *buf, unsigned long len, char *filename)
+{
+    int r = 0;
+    unsigned long len1, len2, textlen;
+    unsigned char *bin1, *bin2 = 0;
+    char *text;
+
+    if (len >= 5 && !memcmp(buf, "BINI\x01", 5)) {
+        fprintf(stderr, PROGRAM_NAME ": %s: input is a BINI file\n",
+                filename);
+        free(buf);
+        return -1;
+    }
+    bin1 = encode(buf, len, filename, &len1);
+    if (!bin1) {
+        free(buf);
+        return -1;
+    }
+    TRACE_BEGIN("format");
+    text = decode(bin1, len1, &textlen);
+    TRACE_END("format");
+    bin2 = encode(text, textlen, filename, &len2);
+    if (!bin2) {
+        fprintf(stderr, PROGRAM_NAME ": %s: round trip text is invalid\n",
+                filename);
+        r = -1;
+    } else if (len1 != len2 || memcmp(bin1, bin2, len1)) {
+        report_difference(filename, bin1, len1, bin2, len2);
+        r = -1;
+    }
+
+    free(bin2);
+    free(text);
+    free(bin1);
+    free(buf);
+    return r;
+}
+
+/* Read and validate one input with check() or verify().
+ */
+static int
+validate_file(int (*validate)(char *, unsigned long, char *), FILE *in,
+              char *filename)
+{
+    int r;
+    char *buf;
+    unsigned long len;
+    TRACE_FILE_BEGIN(filename);
+    TRACE_BEGIN("read");
+    buf = slurp(in, &len);
+    TRACE_END("read");
+    TRACE_BEGIN("validate");
+    r = validate(buf, len, filename);
+    TRACE_END("validate");
+    TRACE_FILE_END(filename, len);
+    return r;
+}
+
+int
+main(int argc, char **argv)
+{
+    int option;
+    int showstats = 0;
+    unsigned long inlen;
+    char *inbuf;
+    FILE *in = stdin;
+    FILE *out = stdout;
+    FILE *final = 0;
+    char *cachedir = 0;
+    char *cachepath = 0;
+    char *sidecar = 0;
+    char *watchdir = 0;
+    char *socketpath = 0;
+    char *tracepath = 0;
+    int (*validate)(char *, unsigned long, char *) = 0;
+    struct parser parser = {"stdin", 1, 0, 0, 0, 0};
+    struct trie *strings;
+
+    while ((option = getopt(argc, argv, "cC:hi:o:rsS:t:T:Vw:")) != -1) {
+        switch (option) {
+            case 'c':
+                validate = check;
+                break;
+            case 'C':
+                cachedir = optarg;
+                break;
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'i':
+                sidecar = optarg;
+                break;
+            case 'o':
+                out = fopen(optarg, "wb");
+                if (!out)
+                    fatal("%s: %s", strerror(errno), optarg);
+                break;
+            case 'r':
+                validate = verify;
+                break;
+            case 's':
+                showstats = 1;
+                break;
+            case 'S':
+                socketpath = optarg;
+                break;
+            case 't':
+                schema = schema_load(optarg);
+                break;
+            case 'T':
+                tracepath = optarg;
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            case 'w':
+                watchdir = optarg;
+                break;
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Interning is timed for the trace as it is for statistics */
+    if (tracepath) {
+#ifdef BINI_TRACE
+        trace_open(tracepath);
+        stats_start();
+#else
+        fatal("tracing requires building with -DBINI_TRACE");
+#endif
+    }
+
+    if (validate) {
+        int i, failed = 0;
+        if (!argv[optind])
+            exit(validate_file(validate, stdin, "stdin") ?
+                 EXIT_FAILURE : EXIT_SUCCESS);
+        for (i = optind; i < argc; i++) {
+            in = fopen(argv[i], "rb");
+            if (!in) {
+                fprintf(stderr, PROGRAM_NAME ": %s: %s\n",
+                        strerror(errno), argv[i]);
+                failed = 1;
+                continue;
             }
-            entry = entry->next;
-            free(edead);
+            failed |= !!validate_file(validate, in, argv[i]);
+            fclose(in);
         }
-        section = section->next;
-        free(sdead);
+        exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
     }
+
+    if (socketpath) {
+#if defined(__unix__) || defined(__APPLE__)
+        if (argv[optind])
+            fatal("server mode takes no input arguments");
+        serve(socketpath, convert_request);
+#else
+        fatal("server mode is only supported on POSIX systems");
+#endif
+    }
+
+    if (watchdir) {
+#ifdef __linux__
+        if (argv[optind])
+            fatal("watch mode takes no input arguments");
+        watch(watchdir, ".txt.ini", convert_path);
+#else
+        fatal("watch mode is only supported on Linux");
+#endif
+    }
+
+    /* Use argument rather than standard input */
+    if (argv[optind]) {
+        if (argv[optind + 1])
+            fatal("too many input arguments");
+        in = fopen(argv[optind], "rb");
+        if (!in)
+            fatal("%s: %s", strerror(errno), argv[optind]);
+        parser.filename = argv[optind];
+    }
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        if (out == stdout)
+            _setmode(_fileno(stdout), 0x8000);
+        if (in == stdin)
+            _setmode(_fileno(stdin), 0x8000);
+    }
+#endif
+
+    strings = trie_create();
+    if (showstats) {
+        stats_start();
+        stats.start = stats_mark;
+    }
+
+    /* Initialize the parser */
+    TRACE_FILE_BEGIN(parser.filename);
+    TRACE_BEGIN("read");
+    parser.p = inbuf = slurp(in, &inlen);
+    parser.end = inbuf + inlen;
+    stats_lap(&stats.read);
+    TRACE_END("read");
+
+    /* Sanity check */
+    if (inlen >= 5 && !memcmp(inbuf, "BINI\x01", 5))
+        fatal("input is a BINI file, use unbini instead: aborting");
+
+    if (cachedir) {
+        cachepath = cache_path(cachedir, schema ? schema->text : "",
+                               inbuf, inlen);
+        if (!cache_fetch(cachepath, out)) {
+            final = out;
+            out = tmpfile();
+            if (!out)
+                fatal("%s", strerror(errno));
+        } else {
+            stats.cache_hit = 1;
+        }
+    }
+
+    if (!cachedir || final) {
+        /* Parse the input into sections */
+        if (sidecar) {
+            convert_incremental(&parser, strings, sidecar, out);
+        } else {
+            convert(&parser, strings, out);
+        }
+    }
+    if (final) {
+        cache_store(cachepath, out, final);
+        out = final;
+    }
+    TRACE_FILE_END(parser.filename, inlen);
+    if (showstats)
+        stats_report(strings, inlen);
+
+    /* Cleanup */
     strings_free(strings);
+    free(cachepath);
     free(inbuf);
 
     if (fclose(out))
@@ -0,0 +1,395 @@
+#define __USE_MINGW_ANSI_STDIO 0
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "biniarc"
+
+#include "common.h"
+#include "getopt.h"
+#include "loader.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " -c [-o path] BINI...\n");
+    fprintf(f, "       " PROGRAM_NAME " -t ARCHIVE\n");
+    fprintf(f, "       " PROGRAM_NAME " -x [-o path] ARCHIVE NAME\n");
+    fprintf(f, "  -c       create an archive from BINI files\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -t       list archive members\n");
+    fprintf(f, "  -V       print version information\n");
+    fprintf(f, "  -x       extract one member as a standalone BINI\n");
+}
+
+/* Archive format
+ *
+ * An archive holds the bodies of many BINI files, the packed section
+ * structures without their headers, and a few shared string pools.
+ * Each member's string offsets refer to one pool. Since offsets are
+ * 16 bits, members are assigned to pools in order, starting a new pool
+ * whenever the current one could overflow.
+ *
+ * All offsets are absolute file offsets so that the whole archive can
+ * be used in place from a single mapping, and the directory is sorted
+ * by member name for binary search. All fields are 32-bit little
+ * endian.
+ *
+ *   struct bina_header { magic "BINA", version 1, nfile, npool };
+ *   struct bina_pool   { offset, length } [npool];
+ *   struct bina_file   { name, pool, body, length } [nfile];
+ *
+ * Then follow the member names, the bodies, and the pools.
+ */
+
+#define ARCHIVE_MAGIC   0x414e4942UL
+#define ARCHIVE_VERSION 0x00000001UL
+
+struct member {
+    const char *name;
+    unsigned char *buf;
+    struct section *sections;
+    long pool;
+    unsigned long size;
+    unsigned long nameoff, bodyoff;
+};
+
+struct pool {
+    struct trie *strings;
+    unsigned long bound;  /* upper bound on its finalized size */
+    unsigned long offset, length;
+};
+
+struct bound {
+    struct trie *pool;
+    unsigned long add;
+};
+
+/* Count the bytes that strings missing from a pool would add to it.
+ * Both tables are keyed by reversed strings, so keys compare directly.
+ */
+static int
+bound_visit(const char *key, void *data, void *arg, int nsiblings)
+{
+    struct bound *b = arg;
+    (void)data;
+    (void)nsiblings;
+    if (!trie_search(b->pool, key))
+        b->add += (unsigned long)strlen(key) + 1;
+    return 0;
+}
+
+static int
+member_cmp(const void *a, const void *b)
+{
+    const struct member *x = a;
+    const struct member *y = b;
+    return strcmp(x->name, y->name);
+}
+
+static unsigned char *
+load_file(const char *path, unsigned long *len)
+{
+    unsigned char *buf;
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        fatal("%s: %s", strerror(errno), path);
+    buf = slurp(in, len);
+    fclose(in);
+    return buf;
+}
+
+static void
+create(char **paths, int n, FILE *out)
+{
+    int i;
+    long npool = 0;
+    unsigned long off;
+    struct pool *pools = 0;
+    struct member *members = xreallocarray(0, n, sizeof(*members));
+
+    for (i = 0; i < n; i++) {
+        unsigned long len;
+        struct bound b;
+        struct section *s;
+        struct member *m = members + i;
+        struct trie *scratch = trie_create();
+        if (!scratch)
+            fatal("out of memory");
+
+        m->name = paths[i];
+        m->buf = load_file(paths[i], &len);
+        m->sections = sections_load(m->buf, len, scratch, paths[i]);
+        m->size = 0;
+        for (s = m->sections; s; s = s->next)
+            m->size += s->size;
+
+        /* Pick a pool with room for this member's new strings */
+        b.add = 0;
+        if (npool) {
+            b.pool = pools[npool - 1].strings;
+            trie_visit(scratch, "", bound_visit, &b);
+        }
+        if (!npool || pools[npool - 1].bound + b.add > 65536UL) {
+            pools = xreallocarray(pools, npool + 1, sizeof(*pools));
+            pools[npool].strings = trie_create();
+            if (!pools[npool].strings)
+                fatal("out of memory");
+            pools[npool].bound = 0;
+            b.pool = pools[npool++].strings;
+            b.add = 0;
+            trie_visit(scratch, "", bound_visit, &b);
+        }
+        pools[npool - 1].bound += b.add;
+        m->pool = npool - 1;
+        sections_reintern(m->sections, pools[npool - 1].strings);
+        strings_free(scratch);
+    }
+
+    qsort(members, n, sizeof(*members), member_cmp);
+    for (i = 1; i < n; i++)
+        if (!strcmp(members[i - 1].name, members[i].name))
+            fatal("duplicate member: %s", members[i].name);
+
+    /* Lay out the archive */
+    off = 16 + 8UL * npool + 16UL * n;
+    for (i = 0; i < n; i++) {
+        members[i].nameoff = off;
+        off += (unsigned long)strlen(members[i].name) + 1;
+    }
+    for (i = 0; i < n; i++) {
+        members[i].bodyoff = off;
+        off += members[i].size;
+    }
+    for (i = 0; i < npool; i++) {
+        pools[i].offset = off;
+        pools[i].length = (unsigned long)strings_finalize(pools[i].strings);
+        off += pools[i].length;
+    }
+    if (off > 0xffffffffUL)
+        fatal("archive too large");
+
+    store_u32(ARCHIVE_MAGIC, out);
+    store_u32(ARCHIVE_VERSION, out);
+    store_u32(n, out);
+    store_u32(npool, out);
+    for (i = 0; i < npool; i++) {
+        store_u32(pools[i].offset, out);
+        store_u32(pools[i].length, out);
+    }
+    for (i = 0; i < n; i++) {
+        store_u32(members[i].nameoff, out);
+        store_u32(members[i].pool, out);
+        store_u32(members[i].bodyoff, out);
+        store_u32(members[i].size, out);
+    }
+    for (i = 0; i < n; i++)
+        fwrite(members[i].name, strlen(members[i].name) + 1, 1, out);
+    for (i = 0; i < n; i++)
+        sections_write_structs(members[i].sections, out);
+    for (i = 0; i < npool; i++)
+        strings_write(pools[i].strings, out);
+
+    /* Clean up */
+    for (i = 0; i < n; i++) {
+        sections_free(members[i].sections);
+        free(members[i].buf);
+    }
+    for (i = 0; i < npool; i++)
+        strings_free(pools[i].strings);
+    free(pools);
+    free(members);
+}
+
+struct archive {
+    unsigned char *buf;
+    unsigned long len;
+    unsigned long nfile, npool;
+    unsigned char *pools;
+    unsigned char *files;
+};
+
+static void
+archive_open(struct archive *a, const char *path)
+{
+    unsigned long i;
+
+    a->buf = load_file(path, &a->len);
+    if (a->len < 16 || parse_u32(a->buf) != ARCHIVE_MAGIC)
+        fatal("%s: not a BINI archive", path);
+    if (parse_u32(a->buf + 4) != ARCHIVE_VERSION)
+        fatal("%s: unknown archive version", path);
+    a->nfile = parse_u32(a->buf + 8);
+    a->npool = parse_u32(a->buf + 12);
+    if (a->npool > (a->len - 16) / 8 ||
+        a->nfile > (a->len - 16 - a->npool * 8) / 16)
+        fatal("%s: truncated archive", path);
+    a->pools = a->buf + 16;
+    a->files = a->pools + a->npool * 8;
+
+    /* Validate everything once so lookups need no further checks */
+    for (i = 0; i < a->npool; i++) {
+        unsigned long off = parse_u32(a->pools + i * 8 + 0);
+        unsigned long len = parse_u32(a->pools + i * 8 + 4);
+        if (off > a->len || len > a->len - off)
+            fatal("%s: invalid string pool", path);
+        if (len && a->buf[off + len - 1])
+            fatal("%s: unterminated string pool", path);
+    }
+    for (i = 0; i < a->nfile; i++) {
+        const unsigned char *f = a->files + i * 16;
+        unsigned long name = parse_u32(f + 0);
+        unsigned long body = parse_u32(f + 8);
+        unsigned long size = parse_u32(f + 12);
+        if (name >= a->len || !memchr(a->buf + name, 0, a->len - name))
+            fatal("%s: invalid member name", path);
+        if (parse_u32(f + 4) >= a->npool)
+            fatal("%s: invalid member pool", path);
+        if (body > a->len || size > a->len - body)
+            fatal("%s: invalid member body", path);
+    }
+}
+
+static void
+list(struct archive *a)
+{
+    unsigned long i;
+    for (i = 0; i < a->nfile; i++)
+        puts((char *)a->buf + parse_u32(a->files + i * 16));
+}
+
+/* Find a member by binary search over the sorted directory.
+ */
+static const unsigned char *
+archive_find(struct archive *a, const char *name)
+{
+    unsigned long lo = 0, hi = a->nfile;
+    while (lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        const unsigned char *f = a->files + mid * 16;
+        int c = strcmp((char *)a->buf + parse_u32(f), name);
+        if (!c)
+            return f;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return 0;
+}
+
+/* Write a member as a standalone BINI file with a minimal string table.
+ */
+static void
+extract(struct archive *a, const char *name, FILE *out)
+{
+    unsigned char *buf;
+    unsigned long body, size, poff, plen;
+    const unsigned char *f = archive_find(a, name);
+    const unsigned char *pool;
+    struct section *sections;
+    struct trie *strings;
+
+    if (!f)
+        fatal("no such member: %s", name);
+    pool = a->pools + parse_u32(f + 4) * 8;
+    body = parse_u32(f + 8);
+    size = parse_u32(f + 12);
+    poff = parse_u32(pool + 0);
+    plen = parse_u32(pool + 4);
+
+    /* Reassemble the member as a BINI file over the whole pool */
+    buf = xmalloc(12 + size + plen);
+    memcpy(buf, "BINI\x01\0\0\0", 8);
+    buf[8]  = (unsigned char)((12 + size) >>  0);
+    buf[9]  = (unsigned char)((12 + size) >>  8);
+    buf[10] = (unsigned char)((12 + size) >> 16);
+    buf[11] = (unsigned char)((12 + size) >> 24);
+    memcpy(buf + 12, a->buf + body, size);
+    memcpy(buf + 12 + size, a->buf + poff, plen);
+
+    strings = trie_create();
+    if (!strings)
+        fatal("out of memory");
+    sections = sections_load(buf, 12 + size + plen, strings, name);
+    strings_finalize(strings);
+    sections_write(sections, strings, out);
+
+    sections_free(sections);
+    strings_free(strings);
+    free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+    int option;
+    int mode = 0;
+    FILE *out = stdout;
+    struct archive a;
+
+    while ((option = getopt(argc, argv, "cho:tVx")) != -1) {
+        switch (option) {
+            case 'c':
+            case 't':
+            case 'x':
+                if (mode)
+                    fatal("only one of -c, -t, or -x may be given");
+                mode = option;
+                break;
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'o':
+                out = fopen(optarg, "wb");
+                if (!out)
+                    fatal("%s: %s", strerror(errno), optarg);
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        if (out == stdout)
+            _setmode(_fileno(stdout), 0x8000);
+    }
+#endif
+
+    switch (mode) {
+        case 'c':
+            if (!argv[optind])
+                fatal("no input files");
+            create(argv + optind, argc - optind, out);
+            break;
+        case 't':
+            if (!argv[optind] || argv[optind + 1])
+                fatal("expected one archive");
+            archive_open(&a, argv[optind]);
+            list(&a);
+            free(a.buf);
+            break;
+        case 'x':
+            if (!argv[optind] || !argv[optind + 1] || argv[optind + 2])
+                fatal("expected an archive and a member name");
+            archive_open(&a, argv[optind]);
+            extract(&a, argv[optind + 1], out);
+            free(a.buf);
+            break;
+        default:
+            usage(stderr);
+            exit(EXIT_FAILURE);
+    }
+
+    if (fclose(out))
+        fatal("%s", strerror(errno));
+    return 0;
+}
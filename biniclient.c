@@ -0,0 +1,168 @@
+#define __USE_MINGW_ANSI_STDIO 0
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "biniclient"
+
+#include "common.h"
+#include "getopt.h"
+
+/* After getopt.h, whose definitions unistd.h would otherwise clash with */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " -S socket [-o path] [<FILE|FILE]\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -S path  socket of a bini or unbini server\n");
+    fprintf(f, "  -V       print version information\n");
+}
+
+/* See server.h for the protocol. */
+
+static void
+send_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len) {
+        ssize_t r = write(fd, p, len);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            fatal("write: %s", strerror(errno));
+        p += r;
+        len -= (size_t)r;
+    }
+}
+
+static void
+recv_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len) {
+        ssize_t r = read(fd, p, len);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            fatal("server closed the connection");
+        p += r;
+        len -= (size_t)r;
+    }
+}
+
+static void
+send_u32(int fd, unsigned long x)
+{
+    unsigned char n[4];
+    n[0] = (unsigned char)(x >>  0);
+    n[1] = (unsigned char)(x >>  8);
+    n[2] = (unsigned char)(x >> 16);
+    n[3] = (unsigned char)(x >> 24);
+    send_all(fd, n, 4);
+}
+
+/* Receive a length-prefixed block and copy it to a stream.
+ */
+static void
+recv_block(int fd, FILE *f)
+{
+    unsigned char n[4];
+    char buf[1 << 14];
+    unsigned long len;
+
+    recv_all(fd, n, 4);
+    len = (unsigned long)n[0] <<  0 | (unsigned long)n[1] <<  8 |
+          (unsigned long)n[2] << 16 | (unsigned long)n[3] << 24;
+    while (len) {
+        size_t z = len < sizeof(buf) ? len : sizeof(buf);
+        recv_all(fd, buf, z);
+        fwrite(buf, z, 1, f);
+        len -= z;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int option, fd;
+    unsigned char status;
+    FILE *in = stdin;
+    FILE *out = stdout;
+    char *name = "stdin";
+    char *socketpath = 0;
+    unsigned char *buf;
+    unsigned long len;
+    struct sockaddr_un addr;
+
+    while ((option = getopt(argc, argv, "ho:S:V")) != -1) {
+        switch (option) {
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'o':
+                out = fopen(optarg, "wb");
+                if (!out)
+                    fatal("%s: %s", strerror(errno), optarg);
+                break;
+            case 'S':
+                socketpath = optarg;
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!socketpath) {
+        usage(stderr);
+        exit(EXIT_FAILURE);
+    }
+    if (argv[optind]) {
+        if (argv[optind + 1])
+            fatal("too many input arguments");
+        in = fopen(argv[optind], "rb");
+        if (!in)
+            fatal("%s: %s", strerror(errno), argv[optind]);
+        name = argv[optind];
+    }
+
+    if (strlen(socketpath) >= sizeof(addr.sun_path))
+        fatal("%s: socket path too long", socketpath);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketpath);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        fatal("socket: %s", strerror(errno));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+        fatal("%s: %s", strerror(errno), socketpath);
+
+    buf = slurp(in, &len);
+    send_all(fd, name, strlen(name) + 1);
+    send_u32(fd, len);
+    send_all(fd, buf, len);
+
+    /* Output first, then diagnostics */
+    recv_all(fd, &status, 1);
+    recv_block(fd, out);
+    recv_block(fd, stderr);
+    close(fd);
+
+    free(buf);
+    if (fclose(out))
+        fatal("%s", strerror(errno));
+    if (in != stdin)
+        fclose(in);
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
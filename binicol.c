@@ -0,0 +1,198 @@
+#define __USE_MINGW_ANSI_STDIO 1
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "binicol"
+
+#include "common.h"
+#include "getopt.h"
+#include "reader.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " [-r] [-o path] QUERY [BINI...]\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -r       raw little-endian 32-bit values instead of CSV\n");
+    fprintf(f, "  -V       print version information\n");
+    fprintf(f, "QUERY is SECTION/KEY or SECTION/KEY[INDEX]\n");
+}
+
+static void
+print_csv_string(const char *s, FILE *out)
+{
+    if (!strpbrk(s, ",\"\r\n")) {
+        fputs(s, out);
+    } else {
+        fputc('"', out);
+        for (; *s; s++) {
+            if (*s == '"')
+                fputc('"', out);
+            fputc(*s, out);
+        }
+        fputc('"', out);
+    }
+}
+
+struct column {
+    struct query query;
+    int raw;
+    int type;  /* raw column type, fixed by the first value */
+    FILE *out;
+};
+
+/* Append one value to the column, returning an error message on
+ * failure.
+ */
+static const char *
+column_push(struct column *c, const char *filename, const unsigned char *text,
+            unsigned section, unsigned key, int type, const unsigned char *v)
+{
+    unsigned long val = parse_u32(v + 1);
+
+    if (c->raw) {
+        if (type == VALUE_STRING)
+            return "strings cannot be written as raw values";
+        if (c->type && type != c->type)
+            return "mixed integer and float values in raw column";
+        c->type = type;
+        fwrite(v + 1, 4, 1, c->out);
+        return 0;
+    }
+
+    print_csv_string(filename, c->out);
+    fputc(',', c->out);
+    print_csv_string((char *)text + section, c->out);
+    fputc(',', c->out);
+    print_csv_string((char *)text + key, c->out);
+    fputc(',', c->out);
+    switch (type) {
+        case VALUE_INTEGER:
+            fprintf(c->out, "%ld", conv_s32(val));
+            break;
+        case VALUE_FLOAT:
+            fprintf(c->out, "%.9g", conv_f32(val));
+            break;
+        case VALUE_STRING:
+            print_csv_string((char *)text + val, c->out);
+            break;
+    }
+    fputc('\n', c->out);
+    return 0;
+}
+
+static void
+extract(struct column *c, const char *filename,
+        const unsigned char *buf, unsigned long len)
+{
+    int e, nvalue;
+    struct reader r;
+    unsigned section, nentry, key;
+    const unsigned char *values;
+
+    if (reader_init(&r, buf, len))
+        fatal("%s: %s", filename, r.err);
+    if (matcher_reset(&c->query.section, r.textlen) ||
+        matcher_reset(&c->query.key, r.textlen))
+        fatal("out of memory");
+
+    while ((e = reader_section(&r, &section, &nentry)) == 1) {
+        if (!matcher_test(&c->query.section, r.text, section))
+            continue;
+        while ((e = reader_entry(&r, &key, &nvalue, &values)) == 1) {
+            int j, beg = 0, end = nvalue;
+            if (!matcher_test(&c->query.key, r.text, key))
+                continue;
+            if (c->query.index >= 0) {
+                beg = (int)c->query.index;
+                end = beg < nvalue ? beg + 1 : beg;
+            }
+            for (j = beg; j < end; j++) {
+                unsigned long val;
+                const char *err;
+                int type = reader_value(&r, values + j * 5, &val);
+                if (type < 0)
+                    fatal("%s: %s", filename, r.err);
+                err = column_push(c, filename, r.text, section, key,
+                                  type, values + j * 5);
+                if (err)
+                    fatal("%s:[%s] %s: %s", filename,
+                          (char *)r.text + section, (char *)r.text + key, err);
+            }
+        }
+        if (e < 0)
+            break;
+    }
+    if (e < 0)
+        fatal("%s: %s", filename, r.err);
+}
+
+int
+main(int argc, char **argv)
+{
+    int option;
+    unsigned long len;
+    unsigned char *buf;
+    static struct column column;
+
+    column.out = stdout;
+    while ((option = getopt(argc, argv, "ho:rV")) != -1) {
+        switch (option) {
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'o':
+                column.out = fopen(optarg, "wb");
+                if (!column.out)
+                    fatal("%s: %s", strerror(errno), optarg);
+                break;
+            case 'r':
+                column.raw = 1;
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!argv[optind]) {
+        usage(stderr);
+        exit(EXIT_FAILURE);
+    }
+    if (query_parse(&column.query, argv[optind++]) || !column.query.key.name)
+        fatal("invalid query, expected SECTION/KEY[INDEX]");
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        if (column.out == stdout)
+            _setmode(_fileno(stdout), 0x8000);
+        _setmode(_fileno(stdin), 0x8000);
+    }
+#endif
+
+    if (!argv[optind]) {
+        buf = slurp(stdin, &len);
+        extract(&column, "stdin", buf, len);
+        free(buf);
+    }
+    for (; argv[optind]; optind++) {
+        FILE *in = fopen(argv[optind], "rb");
+        if (!in)
+            fatal("%s: %s", strerror(errno), argv[optind]);
+        buf = slurp(in, &len);
+        fclose(in);
+        extract(&column, argv[optind], buf, len);
+        free(buf);
+    }
+
+    if (fclose(column.out))
+        fatal("%s", strerror(errno));
+    return 0;
+}
@@ -0,0 +1,347 @@
+#define __USE_MINGW_ANSI_STDIO 1
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "binidiff"
+#define FATAL_STATUS 2  /* as diff: 1 only means the files differ */
+
+#include "common.h"
+#include "getopt.h"
+#include "reader.h"
+#include "trie.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " OLD NEW\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -V       print version information\n");
+}
+
+/* Decoded BINI records
+ *
+ * Sections with the same name are told apart by occurrence: the Nth
+ * [Good] in one file is matched against the Nth [Good] in the other.
+ * Repeated keys within a section are matched the same way.
+ */
+
+struct dentry {
+    unsigned name;
+    int nvalue;
+    const unsigned char *values;
+    struct dentry *next;  /* next unmatched entry of the same name */
+    int matched;
+};
+
+struct dsection {
+    unsigned name;
+    long occurrence;
+    long first;  /* index of first entry */
+    long nentry;
+    struct dsection *next;  /* next unmatched section of the same name */
+    int matched;
+};
+
+struct dfile {
+    const char *path;
+    unsigned char *buf;
+    struct reader r;
+    struct dsection *sections;
+    long nsection;
+    struct dentry *entries;
+    long nentry;
+};
+
+static void
+dfile_load(struct dfile *f, const char *path)
+{
+    int e, nvalue;
+    long i, cap = 0, ecap = 0;
+    unsigned long len;
+    unsigned name, nentry, key;
+    const unsigned char *values;
+    struct trie *seen;
+    FILE *in = fopen(path, "rb");
+
+    if (!in)
+        fatal("%s: %s", strerror(errno), path);
+    f->path = path;
+    f->buf = slurp(in, &len);
+    fclose(in);
+    if (reader_init(&f->r, f->buf, len))
+        fatal("%s: %s", path, f->r.err);
+
+    f->sections = 0;
+    f->nsection = 0;
+    f->entries = 0;
+    f->nentry = 0;
+    while ((e = reader_section(&f->r, &name, &nentry)) == 1) {
+        struct dsection *s;
+        if (f->nsection == cap) {
+            cap = cap ? cap * 2 : 64;
+            f->sections = xreallocarray(f->sections, cap, sizeof(*s));
+        }
+        s = f->sections + f->nsection++;
+        s->name = name;
+        s->first = f->nentry;
+        s->nentry = nentry;
+        s->matched = 0;
+
+        while ((e = reader_entry(&f->r, &key, &nvalue, &values)) == 1) {
+            struct dentry *d;
+            int j;
+            for (j = 0; j < nvalue; j++) {
+                unsigned long val;
+                if (reader_value(&f->r, values + j * 5, &val) < 0)
+                    fatal("%s: %s", path, f->r.err);
+            }
+            if (f->nentry == ecap) {
+                ecap = ecap ? ecap * 2 : 256;
+                f->entries = xreallocarray(f->entries, ecap, sizeof(*d));
+            }
+            d = f->entries + f->nentry++;
+            d->name = key;
+            d->nvalue = nvalue;
+            d->values = values;
+            d->matched = 0;
+        }
+        if (e < 0)
+            break;
+    }
+    if (e < 0)
+        fatal("%s: %s", path, f->r.err);
+
+    /* Number repeated section names */
+    seen = trie_create();
+    if (!seen)
+        fatal("out of memory");
+    for (i = 0; i < f->nsection; i++) {
+        struct dsection *s = f->sections + i;
+        const char *str = (char *)f->r.text + s->name;
+        struct dsection *prev = trie_search(seen, str);
+        s->occurrence = prev ? prev->occurrence + 1 : 0;
+        if (trie_insert(seen, str, s))
+            fatal("out of memory");
+    }
+    trie_free(seen);
+}
+
+static void
+print_name(const struct dfile *f, const struct dsection *s)
+{
+    printf("[%s]", (char *)f->r.text + s->name);
+    if (s->occurrence)
+        printf(":%ld", s->occurrence + 1);
+}
+
+static void
+print_entry(int c, const struct dfile *f, const struct dsection *s,
+            const struct dentry *d)
+{
+    int j;
+    putchar(c);
+    print_name(f, s);
+    printf(" %s =", (char *)f->r.text + d->name);
+    for (j = 0; j < d->nvalue; j++) {
+        const unsigned char *v = d->values + j * 5;
+        unsigned long val = parse_u32(v + 1);
+        fputs(j ? ", " : " ", stdout);
+        switch (v[0]) {
+            case VALUE_INTEGER:
+                printf("%ld", conv_s32(val));
+                break;
+            case VALUE_FLOAT:
+                printf("%.9g", conv_f32(val));
+                break;
+            case VALUE_STRING: {
+                const char *p = (char *)f->r.text + val;
+                putchar('"');
+                for (; *p; p++) {
+                    if (*p == '"')
+                        putchar('"');
+                    putchar(*p);
+                }
+                putchar('"');
+            } break;
+        }
+    }
+    putchar('\n');
+}
+
+static int
+entry_equal(const struct dfile *a, const struct dentry *x,
+            const struct dfile *b, const struct dentry *y)
+{
+    int j;
+    if (x->nvalue != y->nvalue)
+        return 0;
+    for (j = 0; j < x->nvalue; j++) {
+        const unsigned char *v = x->values + j * 5;
+        const unsigned char *w = y->values + j * 5;
+        if (v[0] != w[0])
+            return 0;
+        if (v[0] == VALUE_STRING) {
+            const char *s = (char *)a->r.text + parse_u32(v + 1);
+            const char *t = (char *)b->r.text + parse_u32(w + 1);
+            if (strcmp(s, t))
+                return 0;
+        } else if (memcmp(v + 1, w + 1, 4)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Build a lookup key unique to one section occurrence and entry name.
+ */
+static char *
+entry_key(char *buf, size_t *cap, long section, const char *name)
+{
+    size_t len = strlen(name) + 24;
+    if (len > *cap) {
+        *cap = len;
+        buf = xreallocarray(buf, len, 1);
+    }
+    sprintf(buf, "%ld:%s", section, name);
+    return buf;
+}
+
+static int
+diff(struct dfile *a, struct dfile *b)
+{
+    long i, k;
+    int changed = 0;
+    char *key = 0;
+    size_t keycap = 0;
+    struct trie *sections = trie_create();
+    struct trie *entries = trie_create();
+
+    if (!sections || !entries)
+        fatal("out of memory");
+
+    /* Index the new file, chaining repeated names in order */
+    for (i = b->nsection - 1; i >= 0; i--) {
+        struct dsection *s = b->sections + i;
+        const char *name = (char *)b->r.text + s->name;
+        s->next = trie_search(sections, name);
+        if (trie_insert(sections, name, s))
+            fatal("out of memory");
+        for (k = s->first + s->nentry - 1; k >= s->first; k--) {
+            struct dentry *d = b->entries + k;
+            key = entry_key(key, &keycap, i, (char *)b->r.text + d->name);
+            d->next = trie_search(entries, key);
+            if (trie_insert(entries, key, d))
+                fatal("out of memory");
+        }
+    }
+
+    /* Walk the old file, consuming matches from the index */
+    for (i = 0; i < a->nsection; i++) {
+        struct dsection *s = a->sections + i;
+        const char *name = (char *)a->r.text + s->name;
+        struct dsection *t = trie_search(sections, name);
+
+        if (!t) {
+            changed = 1;
+            putchar('-');
+            print_name(a, s);
+            putchar('\n');
+            for (k = s->first; k < s->first + s->nentry; k++)
+                print_entry('-', a, s, a->entries + k);
+            continue;
+        }
+        if (trie_insert(sections, name, t->next))
+            fatal("out of memory");
+        t->matched = 1;
+
+        for (k = s->first; k < s->first + s->nentry; k++) {
+            struct dentry *d = a->entries + k;
+            struct dentry *e;
+            key = entry_key(key, &keycap, (long)(t - b->sections),
+                            (char *)a->r.text + d->name);
+            e = trie_search(entries, key);
+            if (!e) {
+                changed = 1;
+                print_entry('-', a, s, d);
+                continue;
+            }
+            if (trie_insert(entries, key, e->next))
+                fatal("out of memory");
+            e->matched = 1;
+            if (!entry_equal(a, d, b, e)) {
+                changed = 1;
+                print_entry('-', a, s, d);
+                print_entry('+', b, t, e);
+            }
+        }
+
+        /* Entries only in the new section */
+        for (k = t->first; k < t->first + t->nentry; k++) {
+            if (!b->entries[k].matched) {
+                changed = 1;
+                print_entry('+', b, t, b->entries + k);
+            }
+        }
+    }
+
+    /* Sections only in the new file */
+    for (i = 0; i < b->nsection; i++) {
+        struct dsection *t = b->sections + i;
+        if (t->matched)
+            continue;
+        changed = 1;
+        putchar('+');
+        print_name(b, t);
+        putchar('\n');
+        for (k = t->first; k < t->first + t->nentry; k++)
+            print_entry('+', b, t, b->entries + k);
+    }
+
+    free(key);
+    trie_free(entries);
+    trie_free(sections);
+    return changed;
+}
+
+int
+main(int argc, char **argv)
+{
+    int option, changed;
+    struct dfile a, b;
+
+    while ((option = getopt(argc, argv, "hV")) != -1) {
+        switch (option) {
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(2);
+        }
+    }
+
+    if (!argv[optind] || !argv[optind + 1] || argv[optind + 2]) {
+        usage(stderr);
+        exit(2);
+    }
+
+    dfile_load(&a, argv[optind + 0]);
+    dfile_load(&b, argv[optind + 1]);
+    changed = diff(&a, &b);
+
+    free(a.sections);
+    free(a.entries);
+    free(a.buf);
+    free(b.sections);
+    free(b.entries);
+    free(b.buf);
+
+    if (fflush(stdout))
+        fatal("%s", strerror(errno));
+    return changed;
+}
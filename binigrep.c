@@ -0,0 +1,253 @@
+#define __USE_MINGW_ANSI_STDIO 1
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "binigrep"
+#define FATAL_STATUS 2  /* as grep: 1 only means nothing matched */
+
+#include "common.h"
+#include "getopt.h"
+#include "reader.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " [-lx] PATTERN [BINI...]\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -l       only print the names of matching files\n");
+    fprintf(f, "  -x       strings must match the whole pattern\n");
+    fprintf(f, "  -V       print version information\n");
+}
+
+struct pattern {
+    const char *s;
+    size_t len;
+    int exact;
+    int numeric;
+    double f;
+};
+
+static void
+pattern_init(struct pattern *pat, const char *s, int exact)
+{
+    long i;
+    char *end;
+
+    pat->s = s;
+    pat->len = strlen(s);
+    pat->exact = exact;
+
+    /* Numeric patterns also compare against typed values */
+    pat->numeric = 0;
+    errno = 0;
+    i = strtol(s, &end, 10);
+    if (*s && !*end && (i || !errno)) {
+        pat->numeric = 1;
+        pat->f = (double)i;
+        return;
+    }
+    errno = 0;
+    pat->f = strtod(s, &end);
+    if (*s && !*end && (pat->f || !errno))
+        pat->numeric = 1;
+}
+
+/* Mark every string table offset whose string matches.
+ *
+ * A string table offset may point into the middle of a stored string
+ * due to suffix sharing. For substring matching, an offset matches if
+ * it starts at or before the last occurrence of the pattern within the
+ * stored string. For exact matching, only the one suffix that equals
+ * the pattern can match.
+ *
+ * Returns the number of marked offsets.
+ */
+static long
+mark_hits(const struct pattern *pat, const unsigned char *text,
+          unsigned long textlen, unsigned char *hit)
+{
+    long nhit = 0;
+    unsigned long off = 0;
+
+    memset(hit, 0, textlen);
+    while (off < textlen) {
+        const char *s = (const char *)text + off;
+        size_t len = strlen(s);
+        unsigned long last = (unsigned long)-1;
+
+        if (pat->exact) {
+            if (len >= pat->len && !strcmp(s + len - pat->len, pat->s))
+                last = off + (unsigned long)(len - pat->len);
+            if (last < textlen) {
+                hit[last] = 1;
+                nhit++;
+            }
+        } else {
+            const char *q = strstr(s, pat->s);
+            if (q) {
+                unsigned long i;
+                do
+                    last = off + (unsigned long)(q - s);
+                while (*q && (q = strstr(q + 1, pat->s)));
+                for (i = off; i <= last; i++)
+                    hit[i] = 1;
+                nhit += (long)(i - off);
+            }
+        }
+        off += (unsigned long)len + 1;
+    }
+    return nhit;
+}
+
+/* Search one BINI buffer, printing each hit.
+ * Returns 1 if anything matched, 0 if not, or -1 on error.
+ */
+static int
+grep(const struct pattern *pat, const char *filename,
+     const unsigned char *buf, unsigned long len, int list)
+{
+    static unsigned char *hit;
+    static unsigned long cap;
+    int e, found = 0;
+    struct reader r;
+    unsigned section, nentry, key;
+    int nvalue;
+    const unsigned char *values;
+
+    if (reader_init(&r, buf, len)) {
+        fprintf(stderr, PROGRAM_NAME ": %s: %s\n", filename, r.err);
+        return -1;
+    }
+
+    /* Value offsets are 32 bits, so the marks cover the whole table */
+    if (r.textlen + 1 > cap) {
+        cap = r.textlen + 1;
+        hit = xreallocarray(hit, cap, 1);
+    }
+
+    /* Only walk the body if a string or a typed number might match */
+    if (!mark_hits(pat, r.text, r.textlen, hit) && !pat->numeric)
+        return 0;
+
+    while ((e = reader_section(&r, &section, &nentry)) == 1) {
+        while ((e = reader_entry(&r, &key, &nvalue, &values)) == 1) {
+            int j;
+            for (j = 0; j < nvalue; j++) {
+                unsigned long val;
+                int match = 0;
+                switch (reader_value(&r, values + j * 5, &val)) {
+                    case VALUE_INTEGER:
+                        match = pat->numeric && conv_s32(val) == pat->f;
+                        break;
+                    case VALUE_FLOAT:
+                        match = pat->numeric && conv_f32(val) == (float)pat->f;
+                        break;
+                    case VALUE_STRING:
+                        match = hit[val];
+                        break;
+                    default:
+                        fprintf(stderr, PROGRAM_NAME ": %s: %s\n",
+                                filename, r.err);
+                        return -1;
+                }
+                if (match) {
+                    if (list) {
+                        printf("%s\n", filename);
+                        return 1;
+                    }
+                    printf("%s:[%s] %s\n", filename,
+                           (char *)r.text + section, (char *)r.text + key);
+                    found = 1;
+                    break;
+                }
+            }
+        }
+        if (e < 0)
+            break;
+    }
+    if (e < 0) {
+        fprintf(stderr, PROGRAM_NAME ": %s: %s\n", filename, r.err);
+        return -1;
+    }
+    return found;
+}
+
+int
+main(int argc, char **argv)
+{
+    int option;
+    int list = 0;
+    int exact = 0;
+    int found = 0;
+    int failed = 0;
+    struct pattern pat;
+
+    while ((option = getopt(argc, argv, "hlxV")) != -1) {
+        switch (option) {
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'l':
+                list = 1;
+                break;
+            case 'x':
+                exact = 1;
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(2);
+        }
+    }
+
+    if (!argv[optind]) {
+        usage(stderr);
+        exit(2);
+    }
+    pattern_init(&pat, argv[optind++], exact);
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        _setmode(_fileno(stdin), 0x8000);
+    }
+#endif
+
+    if (!argv[optind]) {
+        unsigned long len;
+        unsigned char *buf = slurp(stdin, &len);
+        int r = grep(&pat, "stdin", buf, len, list);
+        failed = r < 0;
+        found = r > 0;
+        free(buf);
+    } else {
+        for (; argv[optind]; optind++) {
+            int r;
+            unsigned long len;
+            unsigned char *buf;
+            FILE *in = fopen(argv[optind], "rb");
+            if (!in) {
+                fprintf(stderr, PROGRAM_NAME ": %s: %s\n",
+                        strerror(errno), argv[optind]);
+                failed = 1;
+                continue;
+            }
+            buf = slurp(in, &len);
+            fclose(in);
+            r = grep(&pat, argv[optind], buf, len, list);
+            free(buf);
+            if (r < 0)
+                failed = 1;
+            else if (r > 0)
+                found = 1;
+        }
+    }
+
+    if (fflush(stdout))
+        fatal("%s", strerror(errno));
+    return failed ? 2 : !found;
+}
@@ -0,0 +1,266 @@
+#define __USE_MINGW_ANSI_STDIO 0
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "binimerge"
+
+#include "common.h"
+#include "getopt.h"
+#include "loader.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " [-a] [-o path] BASE [OVERLAY...]\n");
+    fprintf(f, "  -a       append overlay sections instead of merging\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -V       print version information\n");
+}
+
+/* Same-named sections or entries, in order of occurrence. Each overlay
+ * consumes them from the front, so its Nth [Good] lands on the Nth
+ * [Good] of the result.
+ */
+struct chain {
+    void **v;
+    long n, cap, used;
+};
+
+static void
+chain_push(struct trie *t, const char *name, void *p)
+{
+    struct chain *c = trie_search(t, name);
+    if (!c) {
+        c = xmalloc(sizeof(*c));
+        c->v = 0;
+        c->n = c->cap = c->used = 0;
+        if (trie_insert(t, name, c))
+            fatal("out of memory");
+    }
+    if (c->n == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 4;
+        c->v = xreallocarray(c->v, c->cap, sizeof(*c->v));
+    }
+    c->v[c->n++] = p;
+}
+
+static void *
+chain_take(struct trie *t, const char *name)
+{
+    struct chain *c = trie_search(t, name);
+    if (!c || c->used == c->n)
+        return 0;
+    return c->v[c->used++];
+}
+
+static int
+chain_free(const char *key, void *data, void *arg, int nsiblings)
+{
+    struct chain *c = data;
+    (void)key;
+    (void)arg;
+    (void)nsiblings;
+    free(c->v);
+    free(c);
+    return 0;
+}
+
+static void
+index_free(struct trie *t)
+{
+    trie_visit(t, "", chain_free, 0);
+    trie_free(t);
+}
+
+static void
+values_free(struct value *value)
+{
+    while (value) {
+        struct value *dead = value;
+        value = value->next;
+        free(dead);
+    }
+}
+
+/* Merge the entries of overlay section O into result section R. An
+ * overlay entry replaces all values of the matching entry, and an
+ * entry with no match is appended to the section.
+ */
+static void
+merge_entries(struct section *r, struct section *o, const char *filename)
+{
+    struct entry *e, *tail = 0;
+    struct trie *index = trie_create();
+
+    if (!index)
+        fatal("out of memory");
+    for (e = r->entries; e; e = e->next) {
+        chain_push(index, e->name->s, e);
+        tail = e;
+    }
+
+    e = o->entries;
+    while (e) {
+        struct entry *next = e->next;
+        struct entry *t = chain_take(index, e->name->s);
+        if (t) {
+            r->size += (e->nvalue - t->nvalue) * 5L;
+            values_free(t->values);
+            t->values = e->values;
+            t->nvalue = e->nvalue;
+            free(e);
+        } else {
+            e->next = 0;
+            if (tail)
+                tail = tail->next = e;
+            else
+                r->entries = tail = e;
+            r->size += 3 + e->nvalue * 5;
+            if (++r->nentry > 65535)
+                fatal("%s: [%s]: too many entries in one section",
+                      filename, r->name->s);
+        }
+        e = next;
+    }
+    o->entries = 0;
+    index_free(index);
+}
+
+/* Merge overlay sections into RESULT, returning the new list tail.
+ */
+static struct section *
+merge(struct section *result, struct section *overlay, const char *filename)
+{
+    struct section *s, *tail = 0;
+    struct trie *index = trie_create();
+
+    if (!index)
+        fatal("out of memory");
+    for (s = result; s; s = s->next) {
+        chain_push(index, s->name->s, s);
+        tail = s;
+    }
+
+    s = overlay;
+    while (s) {
+        struct section *next = s->next;
+        struct section *r = chain_take(index, s->name->s);
+        s->next = 0;
+        if (r) {
+            merge_entries(r, s, filename);
+            sections_free(s);
+        } else {
+            tail = tail->next = s;
+        }
+        s = next;
+    }
+    index_free(index);
+    return tail;
+}
+
+static unsigned char *
+load_file(const char *path, unsigned long *len)
+{
+    unsigned char *buf;
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        fatal("%s: %s", strerror(errno), path);
+    buf = slurp(in, len);
+    fclose(in);
+    return buf;
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, option;
+    int append = 0;
+    int nbuf = 0;
+    FILE *out = stdout;
+    unsigned char **bufs;
+    struct section *result, *tail;
+    struct trie *loaded, *strings;
+
+    while ((option = getopt(argc, argv, "aho:V")) != -1) {
+        switch (option) {
+            case 'a':
+                append = 1;
+                break;
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'o':
+                out = fopen(optarg, "wb");
+                if (!out)
+                    fatal("%s: %s", strerror(errno), optarg);
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!argv[optind]) {
+        usage(stderr);
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        if (out == stdout)
+            _setmode(_fileno(stdout), 0x8000);
+    }
+#endif
+
+    loaded = trie_create();
+    strings = trie_create();
+    if (!loaded || !strings)
+        fatal("out of memory");
+
+    /* Interned strings point into the inputs, so keep them all */
+    bufs = xreallocarray(0, argc - optind, sizeof(*bufs));
+
+    result = tail = 0;
+    for (i = optind; i < argc; i++) {
+        unsigned long len;
+        struct section *sections;
+        bufs[nbuf] = load_file(argv[i], &len);
+        sections = sections_load(bufs[nbuf++], len, loaded, argv[i]);
+        if (!result) {
+            result = sections;
+            for (tail = result; tail && tail->next; tail = tail->next)
+                ;
+        } else if (!sections) {
+            continue;
+        } else if (append) {
+            for (tail->next = sections; tail->next; tail = tail->next)
+                ;
+        } else {
+            tail = merge(result, sections, argv[i]);
+        }
+    }
+
+    /* Build the output string table from surviving references only */
+    sections_reintern(result, strings);
+    strings_free(loaded);
+    strings_finalize(strings);
+    sections_write(result, strings, out);
+
+    /* Clean up */
+    sections_free(result);
+    strings_free(strings);
+    for (i = 0; i < nbuf; i++)
+        free(bufs[i]);
+    free(bufs);
+
+    if (fclose(out))
+        fatal("%s", strerror(errno));
+    return 0;
+}
@@ -0,0 +1,321 @@
+#define __USE_MINGW_ANSI_STDIO 1
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h> /* Only for uint32_t */
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "binipatch"
+
+#include "common.h"
+#include "getopt.h"
+#include "reader.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " [-f] -s QUERY=VALUE [-s ...] BINI\n");
+    fprintf(f, "  -f       let the value's own type replace the old type\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -s set   assign VALUE to SECTION/KEY[INDEX] (repeatable)\n");
+    fprintf(f, "  -V       print version information\n");
+}
+
+struct patch {
+    struct query query;
+    int type;
+    unsigned long val;
+    char *s;     /* string value, resolved to an offset when applied */
+    int quoted;  /* S was quoted, so it can only be a string */
+};
+
+/* A value record to overwrite */
+struct change {
+    unsigned long offset;
+    int type;
+    unsigned long val;  /* unless a string */
+};
+
+static unsigned long
+float_bits(float x)
+{
+    union {
+        float f;
+        uint32_t i;
+    } conv;
+    conv.f = x;
+    return conv.i;
+}
+
+/* Classify and convert a value exactly like bini does.
+ */
+static void
+parse_value(struct patch *p, char *s)
+{
+    long i;
+    float f;
+    char *end;
+    size_t len = strlen(s);
+
+    p->type = VALUE_STRING;
+    p->s = s;
+    p->quoted = len >= 2 && s[0] == '"' && s[len - 1] == '"';
+
+    if (p->quoted) {
+        /* Quoted string, remove quote escapes */
+        char *w = s;
+        s[len - 1] = 0;
+        for (s++; *s; s++) {
+            if (*s == '"' && s[1] == '"')
+                s++;
+            *w++ = *s;
+        }
+        *w = 0;
+        return;
+    }
+
+    if (!strcmp(s, "-0")) {
+        p->type = VALUE_FLOAT;
+        p->val = float_bits(-0.0f);
+        return;
+    }
+
+    errno = 0;
+    i = strtol(s, &end, 10);
+    if (*s && !*end && (i || !errno)) {
+        p->type = VALUE_INTEGER;
+        p->val = (unsigned long)i & 0xffffffffUL;
+        return;
+    }
+
+    errno = 0;
+    f = (float)strtod(s, &end);
+    if (*s && !*end && (f || !errno)) {
+        p->type = VALUE_FLOAT;
+        p->val = float_bits(f);
+    }
+}
+
+/* Convert the value to TYPE, as bini would parse it if the type were
+ * declared. Returns non-zero if it doesn't fit.
+ */
+static int
+coerce_value(const struct patch *p, int type, unsigned long *val)
+{
+    long i;
+    float f;
+    char *end;
+
+    if (type == VALUE_STRING)
+        return 0;  /* any text is a string, resolved later */
+    if (p->quoted || !*p->s)
+        return -1;
+    errno = 0;
+    if (type == VALUE_INTEGER) {
+        i = strtol(p->s, &end, 10);
+        if (*end || (!i && errno))
+            return -1;
+        *val = (unsigned long)i & 0xffffffffUL;
+    } else {
+        f = (float)strtod(p->s, &end);
+        if (*end || (!f && errno))
+            return -1;
+        *val = float_bits(f);
+    }
+    return 0;
+}
+
+static const char *const type_names[] = {
+    0, "an integer", "a float", "a string"
+};
+
+/* Find an addressable string table offset holding exactly S.
+ * Returns -1 if the string is not present.
+ */
+static long
+find_string(const unsigned char *text, unsigned long textlen, const char *s)
+{
+    size_t slen = strlen(s);
+    unsigned long off = 0;
+    while (off < textlen && off < 65536UL) {
+        const char *t = (const char *)text + off;
+        size_t len = strlen(t);
+        if (len >= slen && !strcmp(t + len - slen, s)) {
+            unsigned long r = off + (unsigned long)(len - slen);
+            if (r < 65536UL)
+                return (long)r;
+        }
+        off += (unsigned long)len + 1;
+    }
+    return -1;
+}
+
+static void
+store_u32(unsigned char *p, unsigned long x)
+{
+    p[0] = (unsigned char)(x >>  0);
+    p[1] = (unsigned char)(x >>  8);
+    p[2] = (unsigned char)(x >> 16);
+    p[3] = (unsigned char)(x >> 24);
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, e, option;
+    int force = 0;
+    int npatch = 0;
+    struct patch **patches = 0;
+    char *path;
+    FILE *f;
+    unsigned char *buf;
+    unsigned long len;
+    unsigned long oldlen;
+    struct change *changes = 0;
+    long nchange = 0;
+
+    while ((option = getopt(argc, argv, "fhs:V")) != -1) {
+        switch (option) {
+            case 'f':
+                force = 1;
+                break;
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 's': {
+                struct patch *p = xmalloc(sizeof(*p));
+                char *slash = strchr(optarg, '/');
+                char *eq = strchr(slash ? slash : optarg, '=');
+                if (!slash || !eq)
+                    fatal("invalid assignment, expected QUERY=VALUE");
+                *eq = 0;
+                if (query_parse(&p->query, optarg))
+                    fatal("invalid query");
+                if (p->query.index < 0)
+                    p->query.index = 0;
+                parse_value(p, eq + 1);
+                patches = xreallocarray(patches, npatch + 1, sizeof(*patches));
+                patches[npatch++] = p;
+            } break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    path = argv[optind];
+    if (!path || argv[optind + 1] || !npatch) {
+        usage(stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    f = fopen(path, "r+b");
+    if (!f)
+        fatal("%s: %s", strerror(errno), path);
+    buf = slurp(f, &len);
+    oldlen = len;
+
+    for (i = 0; i < npatch; i++) {
+        struct patch *p = patches[i];
+        struct reader r;
+        unsigned section, nentry, key;
+        int nvalue, string = 0;
+        long j, first = nchange;
+        const unsigned char *values;
+
+        if (reader_init(&r, buf, len))
+            fatal("%s: %s", path, r.err);
+        if (matcher_reset(&p->query.section, r.textlen) ||
+            matcher_reset(&p->query.key, r.textlen))
+            fatal("out of memory");
+
+        /* Find the records, each keeping its type unless forced */
+        while ((e = reader_section(&r, &section, &nentry)) == 1) {
+            if (!matcher_test(&p->query.section, r.text, section))
+                continue;
+            while ((e = reader_entry(&r, &key, &nvalue, &values)) == 1) {
+                struct change *c;
+                const unsigned char *v;
+                unsigned long old;
+                int type;
+                if (!matcher_test(&p->query.key, r.text, key))
+                    continue;
+                if (p->query.index >= nvalue)
+                    fatal("%s:[%s] %s: no value at index %ld", path,
+                          (char *)r.text + section, (char *)r.text + key,
+                          p->query.index);
+                v = values + p->query.index * 5;
+                type = reader_value(&r, v, &old);
+                if (type < 0)
+                    fatal("%s: %s", path, r.err);
+                changes = xreallocarray(changes, nchange + 1,
+                                        sizeof(*changes));
+                c = changes + nchange++;
+                c->offset = (unsigned long)(v - buf);
+                c->type = force ? p->type : type;
+                c->val = p->val;
+                if (!force && coerce_value(p, type, &c->val))
+                    fatal("%s:[%s] %s: '%s' is not %s, use -f to change "
+                          "its type", path, (char *)r.text + section,
+                          (char *)r.text + key, p->s, type_names[type]);
+                string |= c->type == VALUE_STRING;
+            }
+            if (e < 0)
+                break;
+        }
+        if (e < 0)
+            fatal("%s: %s", path, r.err);
+        if (first == nchange)
+            fatal("%s: nothing matched assignment %d", path, i + 1);
+
+        /* Resolve a string value, appending to the table if needed */
+        if (string) {
+            long off = find_string(r.text, r.textlen, p->s);
+            if (off < 0) {
+                size_t slen = strlen(p->s) + 1;
+                if (r.textlen > 65535)
+                    fatal("%s: too many strings", path);
+                off = (long)r.textlen;
+                buf = xreallocarray(buf, len + slen, 1);
+                memcpy(buf + len, p->s, slen);
+                len += (unsigned long)slen;
+            }
+            for (j = first; j < nchange; j++)
+                if (changes[j].type == VALUE_STRING)
+                    changes[j].val = (unsigned long)off;
+        }
+
+        /* Later assignments see the records as changed */
+        for (j = first; j < nchange; j++) {
+            buf[changes[j].offset] = (unsigned char)changes[j].type;
+            store_u32(buf + changes[j].offset + 1, changes[j].val);
+        }
+    }
+
+    /* Write only the changed value records and any appended strings */
+    for (i = 0; i < nchange; i++) {
+        if (fseek(f, (long)changes[i].offset, SEEK_SET) ||
+            !fwrite(buf + changes[i].offset, 5, 1, f))
+            fatal("%s: %s", path, strerror(errno));
+    }
+    if (len > oldlen) {
+        if (fseek(f, (long)oldlen, SEEK_SET) ||
+            !fwrite(buf + oldlen, len - oldlen, 1, f))
+            fatal("%s: %s", path, strerror(errno));
+    }
+    if (fclose(f))
+        fatal("%s: %s", path, strerror(errno));
+
+    for (i = 0; i < npatch; i++) {
+        free(patches[i]->query.section.memo);
+        free(patches[i]->query.key.memo);
+        free(patches[i]);
+    }
+    free(patches);
+    free(changes);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#define __USE_MINGW_ANSI_STDIO 0
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "binirepack"
+
+#include "common.h"
+#include "getopt.h"
+#include "loader.h"
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: " PROGRAM_NAME " [-o path] [<BINI|BINI]\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -V       print version information\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    int option;
+    FILE *in = stdin;
+    FILE *out = stdout;
+    char *filename = "stdin";
+    unsigned long len;
+    unsigned char *buf;
+    struct section *sections;
+    struct trie *strings;
+
+    while ((option = getopt(argc, argv, "ho:V")) != -1) {
+        switch (option) {
+            case 'h':
+                usage(stdout);
+                exit(EXIT_SUCCESS);
+            case 'o':
+                out = fopen(optarg, "wb");
+                if (!out)
+                    fatal("%s: %s", strerror(errno), optarg);
+                break;
+            case 'V':
+                version();
+                exit(EXIT_SUCCESS);
+            default:
+                usage(stderr);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argv[optind]) {
+        /* Open given filename */
+        if (argv[optind + 1])
+            fatal("too many input arguments");
+        in = fopen(argv[optind], "rb");
+        if (!in)
+            fatal("%s: %s", strerror(errno), argv[optind]);
+        filename = argv[optind];
+    }
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        if (out == stdout)
+            _setmode(_fileno(stdout), 0x8000);
+        if (in == stdin)
+            _setmode(_fileno(stdin), 0x8000);
+    }
+#endif
+
+    strings = trie_create();
+    if (!strings)
+        fatal("out of memory");
+    buf = slurp(in, &len);
+
+    sections = sections_load(buf, len, strings, filename);
+    strings_finalize(strings);
+    sections_write(sections, strings, out);
+
+    /* Clean up */
+    sections_free(sections);
+    strings_free(strings);
+    free(buf);
+
+    if (fclose(out))
+        fatal("%s", strerror(errno));
+    if (in != stdin)
+        fclose(in);
+    return 0;
+}
@@ -0,0 +1,184 @@
+#ifndef BUILDER_H
+#define BUILDER_H
+
+/* Build BINI files directly from data in memory, for generators that
+ * would otherwise print text INI only for bini to parse it back. The
+ * output is identical to converting the equivalent text, and the same
+ * limits apply: 255 values per entry, 65535 entries per section, and
+ * a string table small enough to address. Breaking a limit is fatal,
+ * as it is in bini. Requires common.h.
+ *
+ *     struct builder *b = builder_create();
+ *     builder_section(b, "Good");
+ *     builder_entry(b, "nickname");
+ *     builder_string(b, "commodity_gold");
+ *     builder_entry(b, "price");
+ *     builder_int(b, 120);
+ *     builder_float(b, 0.5f);
+ *     builder_finish(b, out);
+ */
+
+#include <stdint.h> /* Only for uint32_t */
+
+#include "writer.h"
+
+/**
+ * Start an empty BINI file.
+ */
+struct builder *builder_create(void);
+
+/**
+ * Append a section, which receives the entries added after it.
+ */
+void builder_section(struct builder *, const char *name);
+
+/**
+ * Append an entry to the current section, which receives the values
+ * appended after it.
+ */
+void builder_entry(struct builder *, const char *name);
+
+/**
+ * Append a value to the current entry. Integers are stored in 32 bits
+ * as bini stores them. Strings are copied, so the argument need not
+ * outlive the call.
+ */
+void builder_int(struct builder *, long);
+void builder_float(struct builder *, float);
+void builder_string(struct builder *, const char *);
+
+/**
+ * Write the complete BINI file to OUT and free the builder.
+ */
+void builder_finish(struct builder *, FILE *out);
+
+/* Implementation */
+
+struct builder {
+    struct trie *strings;
+    struct section *sections;
+    struct section *section;  /* current section */
+    struct entry *entry;      /* current entry */
+    struct value *value;      /* last value of the current entry */
+};
+
+/* Intern S, copying it only if the string is new.
+ */
+static struct string *
+builder_intern(struct builder *b, const char *s)
+{
+    return strings_push(b->strings, s, strlen(s), 1);
+}
+
+static void
+builder_value(struct builder *b, int type, unsigned long u, const char *s)
+{
+    struct value *value;
+    if (!b->entry)
+        fatal("value outside of an entry");
+    if (b->entry->nvalue == 255)
+        fatal("too many values in one entry");
+    value = xmalloc(sizeof(*value));
+    value->next = 0;
+    value->type = type;
+    if (s)
+        value->value.s = builder_intern(b, s);
+    else
+        value->value.u = u & 0xffffffffUL;
+    if (b->value)
+        b->value->next = value;
+    else
+        b->entry->values = value;
+    b->value = value;
+    b->entry->nvalue++;
+    b->section->size += 5;
+}
+
+struct builder *
+builder_create(void)
+{
+    struct builder *b = xmalloc(sizeof(*b));
+    b->strings = trie_create();
+    if (!b->strings)
+        fatal("out of memory");
+    b->sections = b->section = 0;
+    b->entry = 0;
+    b->value = 0;
+    return b;
+}
+
+void
+builder_section(struct builder *b, const char *name)
+{
+    struct section *section = xmalloc(sizeof(*section));
+    section->next = 0;
+    section->name = builder_intern(b, name);
+    section->entries = 0;
+    section->nentry = 0;
+    section->size = 4;
+    if (b->section)
+        b->section->next = section;
+    else
+        b->sections = section;
+    b->section = section;
+    b->entry = 0;
+    b->value = 0;
+}
+
+void
+builder_entry(struct builder *b, const char *name)
+{
+    struct entry *entry;
+    if (!b->section)
+        fatal("entry outside of a section");
+    if (b->section->nentry == 65535)
+        fatal("too many entries in one section");
+    entry = xmalloc(sizeof(*entry));
+    entry->next = 0;
+    entry->name = builder_intern(b, name);
+    entry->values = 0;
+    entry->nvalue = 0;
+    if (b->entry)
+        b->entry->next = entry;
+    else
+        b->section->entries = entry;
+    b->entry = entry;
+    b->value = 0;
+    b->section->nentry++;
+    b->section->size += 3;
+}
+
+void
+builder_int(struct builder *b, long x)
+{
+    builder_value(b, VALUE_INTEGER, (unsigned long)x, 0);
+}
+
+void
+builder_float(struct builder *b, float x)
+{
+    union {
+        float f;
+        uint32_t i;
+    } conv;
+    conv.f = x;
+    builder_value(b, VALUE_FLOAT, conv.i, 0);
+}
+
+void
+builder_string(struct builder *b, const char *s)
+{
+    builder_value(b, VALUE_STRING, 0, s);
+}
+
+void
+builder_finish(struct builder *b, FILE *out)
+{
+    strings_finalize(b->strings);
+    sections_write(b->sections, b->strings, out);
+    sections_free(b->sections);
+    strings_free(b->strings);
+    free(b);
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+/* Conversion cache
+ *
+ * Converted outputs are kept in a directory under names derived from
+ * the program name, its version, any output-affecting options, and a
+ * hash of the complete input. An unchanged input then costs only a
+ * hash and a copy. A hit is trusted without comparing inputs, so the
+ * hash must make an accidental collision unthinkable: it is the 128-bit
+ * MurmurHash3 for 32-bit machines, computed over the option string and
+ * then over the input, seeded by the former.
+ *
+ * Requires common.h, and on POSIX systems that getopt.h, if used, was
+ * included first, as unistd.h would otherwise clash with it.
+ */
+
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#  include <unistd.h>
+#  define CACHE_PID() ((long)getpid())
+#elif defined(_WIN32)
+#  include <process.h>
+#  define CACHE_PID() ((long)_getpid())
+#else
+#  define CACHE_PID() 0L
+#endif
+
+#define CACHE_ROTL(x, r) \
+    (((x) << (r) | (x) >> (32 - (r))) & 0xffffffffUL)
+
+/* MurmurHash3's final avalanche of a 32-bit word. */
+static unsigned long
+cache_fmix(unsigned long h)
+{
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bUL) & 0xffffffffUL;
+    h ^= h >> 13;
+    h = (h * 0xc2b2ae35UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Run MurmurHash3 x86_128 over a buffer, seeding the four lanes with
+ * the initial contents of H rather than a single word.
+ */
+static void
+cache_murmur(const void *buf, unsigned long len, unsigned long h[4])
+{
+    static const unsigned long c[4] = {
+        0x239b961bUL, 0xab0e9789UL, 0x38b34ae5UL, 0xa1e38b93UL
+    };
+    static const unsigned long add[4] = {
+        0x561ccd1bUL, 0x0bcaa747UL, 0x96cd1c35UL, 0x32ac3b17UL
+    };
+    static const int kr[4] = {15, 16, 17, 18}, hr[4] = {19, 17, 15, 13};
+    const unsigned char *p = buf;
+    unsigned long i, k[4];
+    int j;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        for (j = 0; j < 4; j++) {
+            const unsigned char *q = p + i + j*4;
+            k[j] = (unsigned long)q[0] <<  0 | (unsigned long)q[1] <<  8 |
+                   (unsigned long)q[2] << 16 | (unsigned long)q[3] << 24;
+        }
+        for (j = 0; j < 4; j++) {
+            k[j] = (k[j] * c[j]) & 0xffffffffUL;
+            k[j] = CACHE_ROTL(k[j], kr[j]);
+            k[j] = (k[j] * c[(j + 1) % 4]) & 0xffffffffUL;
+            h[j] ^= k[j];
+            h[j] = CACHE_ROTL(h[j], hr[j]);
+            h[j] = (h[j] + h[(j + 1) % 4]) & 0xffffffffUL;
+            h[j] = (h[j]*5 + add[j]) & 0xffffffffUL;
+        }
+    }
+
+    /* The tail, up to 15 bytes, goes into the lanes unrotated */
+    k[0] = k[1] = k[2] = k[3] = 0;
+    for (j = 0; i + j < len; j++)
+        k[j / 4] |= (unsigned long)p[i + j] << (j % 4 * 8);
+    for (j = 0; j < 4; j++) {
+        if (k[j]) {
+            k[j] = (k[j] * c[j]) & 0xffffffffUL;
+            k[j] = CACHE_ROTL(k[j], kr[j]);
+            k[j] = (k[j] * c[(j + 1) % 4]) & 0xffffffffUL;
+            h[j] ^= k[j];
+        }
+    }
+
+    for (j = 0; j < 4; j++)
+        h[j] ^= len & 0xffffffffUL;
+    h[0] = (h[0] + h[1] + h[2] + h[3]) & 0xffffffffUL;
+    for (j = 1; j < 4; j++)
+        h[j] = (h[j] + h[0]) & 0xffffffffUL;
+    for (j = 0; j < 4; j++)
+        h[j] = cache_fmix(h[j]);
+    h[0] = (h[0] + h[1] + h[2] + h[3]) & 0xffffffffUL;
+    for (j = 1; j < 4; j++)
+        h[j] = (h[j] + h[0]) & 0xffffffffUL;
+}
+
+/* Hash a buffer, salted by an option string, into four 32-bit words.
+ */
+static void
+cache_hash(const char *salt, const void *buf, unsigned long len,
+           unsigned long hash[4])
+{
+    hash[0] = hash[1] = hash[2] = hash[3] = 0;
+    cache_murmur(salt, strlen(salt), hash);
+    cache_murmur(buf, len, hash);
+}
+
+/* Build the cache file name for an input, salted by an option string.
+ */
+static char *
+cache_path(const char *dir, const char *salt, const void *buf,
+           unsigned long len)
+{
+    static const char prefix[] = PROGRAM_NAME "-" PROGRAM_VERSION "-";
+    unsigned long h[4];
+    char *path;
+
+    cache_hash(salt, buf, len, h);
+    path = xmalloc(strlen(dir) + sizeof(prefix) + 34);
+    sprintf(path, "%s/%s%08lx%08lx%08lx%08lx", dir, prefix,
+            h[0], h[1], h[2], h[3]);
+    return path;
+}
+
+/* Copy the remainder of IN to A and, if not null, to B.
+ * Returns -1 if A could not be written, -2 if only B failed.
+ */
+static int
+cache_copy(FILE *in, FILE *a, FILE *b)
+{
+    static char buf[1 << 14];
+    int r = 0;
+    for (;;) {
+        size_t n = fread(buf, 1, sizeof(buf), in);
+        if (n && !fwrite(buf, n, 1, a))
+            return -1;
+        if (b && n && !r && !fwrite(buf, n, 1, b))
+            r = -2;
+        if (n < sizeof(buf))
+            return ferror(in) ? -1 : r;
+    }
+}
+
+/* Copy a cached output to OUT.
+ * Returns non-zero on a cache hit.
+ */
+static int
+cache_fetch(const char *path, FILE *out)
+{
+    int r;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    r = cache_copy(f, out, 0);
+    fclose(f);
+    if (r)
+        fatal("error copying cached output");
+    return 1;
+}
+
+/* Deliver the output accumulated in TMP to OUT and record it in the
+ * cache. An entry only ever appears complete, renamed from a name
+ * private to this process so that concurrent stores of one key can't
+ * mix, and a failure to store it is harmless and ignored.
+ */
+static void
+cache_store(const char *path, FILE *tmp, FILE *out)
+{
+    int r;
+    FILE *f;
+    char *part = xmalloc(strlen(path) + 32);
+
+    sprintf(part, "%s.%ld.part", path, CACHE_PID());
+    f = fopen(part, "wb");
+    if (fflush(tmp))
+        fatal("error writing output");
+    rewind(tmp);
+    r = cache_copy(tmp, out, f);
+    if (r == -1)
+        fatal("error writing output");
+    if (f) {
+        if (fclose(f) || r || rename(part, path))
+            remove(part);
+    }
+    fclose(tmp);
+    free(part);
+}
+
+#endif
@@ -7,14 +7,10 @@
 
 #define PROGRAM_VERSION "2.4"
 
-static void
-usage(FILE *f)
-{
-    fprintf(f, "usage: " PROGRAM_NAME " [-o path] [<INI|INI]\n");
-    fprintf(f, "  -h       print this message\n");
-    fprintf(f, "  -o path  output to a file (default: standard output)\n");
-    fprintf(f, "  -V       print version information\n");
-}
+/* Tools whose exit status has other meanings override this */
+#ifndef FATAL_STATUS
+#  define FATAL_STATUS EXIT_FAILURE
+#endif
 
 static void
 version(void)
@@ -31,13 +27,19 @@ fatal(const char *fmt, ...)
     vfprintf(stderr, fmt, ap);
     fputc('\n', stderr);
     va_end(ap);
-    exit(EXIT_FAILURE);
+    exit(FATAL_STATUS);
 }
 
+/* Allocation totals, reported by stats.h */
+static unsigned long alloc_count;
+static unsigned long alloc_bytes;
+
 static void *
 xmalloc(size_t z)
 {
     void *p = malloc(z);
+    alloc_count++;
+    alloc_bytes += (unsigned long)z;
     if (!p)
         fatal("out of memory");
     return p;
@@ -49,6 +51,8 @@ xreallocarray(void *p, size_t n, size_t m)
     if (n && m > (size_t)-1 / n)
         fatal("out of memory");
     p = realloc(p, n * m);
+    alloc_count++;
+    alloc_bytes += (unsigned long)(n * m);
     if (!p)
         fatal("out of memory");
     return p;
@@ -0,0 +1,207 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+/* INI text formatting for decoded BINI values
+ *
+ * Strings are quoted whenever they would otherwise be parsed back as
+ * something else, and floats are printed in the shortest form that
+ * parses back to the same value, so that the text converts back to
+ * the same BINI file. Both unbini and bini -r print through
+ * print_section() and print_entry(), so that they always agree.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reader.h"
+
+/* Print a string, potentially quoted/escaped.
+ *
+ * If S contains any character from SPECIAL, it will be quoted. If
+ * SPECIAL is a null pointer, always printed it quoted.
+ */
+static void
+print_special(const unsigned char *s, char *special, FILE *out)
+{
+    int simple = *s != 0 && special && !strpbrk((char *)s, special);
+    if (simple) {
+        fputs((char *)s, out);
+    } else {
+        const char *q;
+        fputc('"', out);
+        /* Write through each quote, then double it */
+        while ((q = strchr((char *)s, '"'))) {
+            fwrite(s, 1, q - (char *)s + 1, out);
+            fputc('"', out);
+            s = (unsigned char *)q + 1;
+        }
+        fputs((char *)s, out);
+        fputc('"', out);
+    }
+}
+
+static void
+print_section_name(const unsigned char *s, FILE *out)
+{
+    fputc('[', out);
+    print_special(s, "\"[] \f\n\r\t\v", out);
+    fputs("]\n", out);
+}
+
+static void
+print_entry_name(const unsigned char *s, FILE *out)
+{
+    print_special(s, "\"=[] \f\n\r\t\v", out);
+    fputs(" =", out);
+}
+
+static void
+print_string(const unsigned char *s, FILE *out)
+{
+    long i;
+    double f;
+    char *end;
+
+    /* Does it look like a float? Quote it. */
+    errno = 0;
+    f = strtod((char *)s, &end);
+    if ((f != 0 || !errno) && *end == 0) {
+        print_special(s, 0, out);
+        return;
+    }
+
+    /* Does it look an integer? Quote it. */
+    errno = 0;
+    i = strtol((char *)s, &end, 10);
+    if ((i != 0 || !errno) && *end == 0) {
+        print_special(s, 0, out);
+        return;
+    }
+
+    /* Print it as a string, maybe quoting it. */
+    print_special(s, "\", \f\n\r\t\v", out);
+}
+
+/* Print the simplest form that parses identically with strtod().
+ */
+static void
+print_minfloat(float f, FILE *out)
+{
+    int i;
+    int bestlen;
+    char best[32];
+
+    /* Assume %#.9g is valid and start with it as the best */
+    bestlen = sprintf(best, "%#.9g", f);
+
+    /* Try to find something shorter */
+    for (i = 8; i > 0; i--) {
+        char buf[sizeof(best)];
+        int len = sprintf(buf, "%#.*g", i, f);
+        if (f == (float)strtod(buf, 0)) {
+            /* It's valid, but is it shorter? */
+            if (len < bestlen) {
+                bestlen = len;
+                memcpy(best, buf, sizeof(buf));
+            }
+        } else {
+            /* Precision is now being lost, bailout */
+            break;
+        }
+    }
+    fwrite(best, bestlen, 1, out);
+}
+
+/* Compact output, for text read back by bini rather than by people
+ *
+ * Nothing is spaced out, and strings are quoted by a rule that needs no
+ * trial parsing: bini only tries to read a number from an unquoted
+ * value that begins with one of the characters below, so a string that
+ * doesn't is safe unquoted, and one that does is simply quoted. Any ';'
+ * is quoted too, since it would otherwise begin a comment.
+ */
+
+static void
+print_compact_section_name(const unsigned char *s, FILE *out)
+{
+    fputc('[', out);
+    print_special(s, "\";[] \f\n\r\t\v", out);
+    fputs("]\n", out);
+}
+
+static void
+print_compact_entry_name(const unsigned char *s, FILE *out)
+{
+    print_special(s, "\";=[] \f\n\r\t\v", out);
+    fputc('=', out);
+}
+
+static void
+print_compact_string(const unsigned char *s, FILE *out)
+{
+    int numeric = *s && strchr("+-.0123456789iInN", *s);
+    print_special(s, numeric ? 0 : "\",; \f\n\r\t\v", out);
+}
+
+/* Print a section header, separated from any PRINTED before it by a
+ * blank line unless COMPACT.
+ */
+static void
+print_section(const unsigned char *name, int compact, int printed,
+              FILE *out)
+{
+    if (compact) {
+        print_compact_section_name(name, out);
+    } else {
+        if (printed)
+            fputc('\n', out);
+        print_section_name(name, out);
+    }
+}
+
+/* Print an entry and its values as one line. Returns non-zero if a
+ * value is invalid, with the reader's error set.
+ */
+static int
+print_entry(struct reader *r, unsigned name, int nvalue,
+            const unsigned char *values, int compact, FILE *out)
+{
+    int j;
+    if (compact)
+        print_compact_entry_name(r->text + name, out);
+    else
+        print_entry_name(r->text + name, out);
+    for (j = 0; j < nvalue; j++) {
+        unsigned long val;
+        int type = reader_value(r, values + j * 5, &val);
+
+        if (compact) {
+            if (j)
+                fputc(',', out);
+        } else {
+            fputs(j ? ", " : " ", out);
+        }
+        switch (type) {
+            case VALUE_INTEGER:
+                fprintf(out, "%ld", conv_s32(val));
+                break;
+            case VALUE_FLOAT:
+                print_minfloat(conv_f32(val), out);
+                break;
+            case VALUE_STRING:
+                if (compact)
+                    print_compact_string(r->text + val, out);
+                else
+                    print_string(r->text + val, out);
+                break;
+            default:
+                return -1;
+        }
+    }
+    fputc('\n', out);
+    return 0;
+}
+
+#endif
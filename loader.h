@@ -0,0 +1,133 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+/* Load BINI files into the writer's structures for binary-to-binary
+ * tools. Requires common.h.
+ */
+
+#include "reader.h"
+#include "writer.h"
+
+/**
+ * Decode a BINI buffer into sections, interning every referenced
+ * string. The interned strings point into BUF, which must outlive the
+ * returned sections. Integer and float values are carried over as raw
+ * bit patterns. FILENAME prefixes diagnostics.
+ */
+struct section *sections_load(unsigned char *buf, unsigned long len,
+                              struct trie *strings, const char *filename);
+
+/**
+ * Move every string referenced by the sections into a fresh intern
+ * table, leaving behind any strings that are no longer used. The new
+ * table views the same storage, so loaded buffers must outlive it.
+ */
+void sections_reintern(struct section *, struct trie *strings);
+
+/* Implementation */
+
+static struct string *
+load_string(struct trie *strings, const unsigned char *text,
+            unsigned long offset)
+{
+    const char *s = (const char *)text + offset;
+    return strings_push(strings, s, strlen(s), 0);
+}
+
+struct section *
+sections_load(unsigned char *buf, unsigned long len, struct trie *strings,
+              const char *filename)
+{
+    int e, nvalue;
+    struct reader r;
+    struct section head = {0};
+    struct section *tail = &head;
+    unsigned name, nentry, key;
+    const unsigned char *values;
+
+    if (reader_init(&r, buf, len))
+        fatal("%s: %s", filename, r.err);
+
+    while ((e = reader_section(&r, &name, &nentry)) == 1) {
+        struct entry *etail = 0;
+        struct section *section = xmalloc(sizeof(*section));
+        section->next = 0;
+        section->name = load_string(strings, r.text, name);
+        section->entries = 0;
+        section->nentry = nentry;
+        section->size = 4;
+        tail = tail->next = section;
+
+        while ((e = reader_entry(&r, &key, &nvalue, &values)) == 1) {
+            int j;
+            struct value *vtail = 0;
+            struct entry *entry = xmalloc(sizeof(*entry));
+            entry->next = 0;
+            entry->name = load_string(strings, r.text, key);
+            entry->values = 0;
+            entry->nvalue = nvalue;
+            if (!etail)
+                section->entries = etail = entry;
+            else
+                etail = etail->next = entry;
+            section->size += 3 + nvalue * 5;
+
+            for (j = 0; j < nvalue; j++) {
+                unsigned long val;
+                struct value *value = xmalloc(sizeof(*value));
+                value->next = 0;
+                value->type = reader_value(&r, values + j * 5, &val);
+                switch (value->type) {
+                    case VALUE_INTEGER:
+                    case VALUE_FLOAT:
+                        value->value.u = val;
+                        break;
+                    case VALUE_STRING:
+                        value->value.s = load_string(strings, r.text, val);
+                        break;
+                    default:
+                        fatal("%s: %s", filename, r.err);
+                }
+                if (!vtail)
+                    entry->values = vtail = value;
+                else
+                    vtail = vtail->next = value;
+            }
+        }
+        if (e < 0)
+            break;
+    }
+    if (e < 0)
+        fatal("%s: %s", filename, r.err);
+
+    /* Anything between the last section and the text is dropped */
+    if (r.p != r.text) {
+        int c = (int)(r.text - r.p);
+        fprintf(stderr, "warning: %s: dropping %d garbage byte%s\n",
+                filename, c, c == 1 ? "" : "s");
+    }
+    return head.next;
+}
+
+void
+sections_reintern(struct section *section, struct trie *strings)
+{
+    for (; section; section = section->next) {
+        struct entry *entry;
+        section->name = strings_push(strings, section->name->s,
+                                     section->name->len, 0);
+        for (entry = section->entries; entry; entry = entry->next) {
+            struct value *value;
+            entry->name = strings_push(strings, entry->name->s,
+                                       entry->name->len, 0);
+            for (value = entry->values; value; value = value->next) {
+                if (value->type == VALUE_STRING) {
+                    struct string *s = value->value.s;
+                    value->value.s = strings_push(strings, s->s, s->len, 0);
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,347 @@
+#ifndef READER_H
+#define READER_H
+
+/**
+ * Validating reader for BINI buffers. The reader walks the packed
+ * section, entry, and value structures in place, with no decoding
+ * beyond what the caller asks for. Every offset is bounds checked
+ * before it is handed to the caller, so string table offsets may be
+ * used directly as indexes into the text segment.
+ *
+ * Errors are reported as a static message in the reader's err field
+ * so that callers decide whether a bad file is fatal.
+ */
+
+#include <stdio.h>
+#include <stdint.h> /* Only for uint32_t */
+#include <stdlib.h>
+#include <string.h>
+
+#define VALUE_INTEGER 1
+#define VALUE_FLOAT   2
+#define VALUE_STRING  3
+
+struct reader {
+    const unsigned char *buf;
+    const unsigned char *p;     /* next unread structure */
+    const unsigned char *text;  /* string table */
+    unsigned long textlen;
+    unsigned nentry;            /* entries left in the current section */
+    const char *err;
+};
+
+/**
+ * Validate the header of a BINI buffer and prepare to read it.
+ * @return 0 on success
+ */
+int reader_init(struct reader *, const unsigned char *buf, unsigned long len);
+
+/**
+ * Advance to the next section, skipping any unread entries of the
+ * current section.
+ * @return 1 on success, 0 at the end of the sections, -1 on error
+ */
+int reader_section(struct reader *, unsigned *name, unsigned *nentry);
+
+/**
+ * Read the next entry of the current section. VALUES points at the
+ * NVALUE packed 5-byte value records, which are consumed along with
+ * the entry.
+ * @return 1 on success, 0 at the end of the section, -1 on error
+ */
+int reader_entry(struct reader *, unsigned *name, int *nvalue,
+                 const unsigned char **values);
+
+/**
+ * Decode a single value record returned by reader_entry().
+ * @return the value type, or -1 on error
+ */
+int reader_value(struct reader *, const unsigned char *v, unsigned long *val);
+
+/**
+ * Decode little-endian fields and reinterpret 32-bit values.
+ */
+unsigned long parse_u32(const unsigned char *);
+unsigned parse_u16(const unsigned char *);
+long conv_s32(unsigned long);
+float conv_f32(unsigned long);
+
+/* Name matching for queries
+ *
+ * Names are referenced by string table offset, so each offset is
+ * compared against the query at most once and the result remembered.
+ * Every later reference to the same name costs a single table lookup.
+ * The memo only spans the offsets a name can have in the table at hand,
+ * so a lookup in a small file costs little more than its walk. A null
+ * name matches everything, and a name ending in '*' matches by prefix.
+ */
+
+#define MATCH_UNKNOWN 0
+#define MATCH_YES     1
+#define MATCH_NO      2
+struct matcher {
+    const char *name;
+    size_t len;
+    int prefix;
+    unsigned char *memo;        /* per name offset, sized by reset */
+    unsigned long memolen;
+};
+
+/**
+ * Prepare a matcher for NAME, which may be NULL to match anything.
+ */
+void matcher_init(struct matcher *, const char *name);
+
+/**
+ * Size the memo for a string table of TEXTLEN bytes, forgetting any
+ * remembered results. Required before testing the names of each table.
+ * @return 0 on success, -1 if out of memory
+ */
+int matcher_reset(struct matcher *, unsigned long textlen);
+
+/**
+ * Does the string at OFFSET match? OFFSET must already be validated.
+ */
+int matcher_test(struct matcher *, const unsigned char *text, unsigned offset);
+
+/* A SECTION, SECTION/KEY, or SECTION/KEY[INDEX] query. The index is
+ * negative when not given.
+ */
+struct query {
+    struct matcher section;
+    struct matcher key;
+    long index;
+};
+
+/**
+ * Parse a query string, destroying the argument.
+ * @return 0 on success
+ */
+int query_parse(struct query *, char *arg);
+
+/* Implementation */
+
+unsigned long
+parse_u32(const unsigned char *p)
+{
+    return (unsigned long)p[0] <<  0 |
+           (unsigned long)p[1] <<  8 |
+           (unsigned long)p[2] << 16 |
+           (unsigned long)p[3] << 24;
+}
+
+unsigned
+parse_u16(const unsigned char *p)
+{
+    return (unsigned)p[0] <<  0 |
+           (unsigned)p[1] <<  8;
+}
+
+long
+conv_s32(unsigned long x)
+{
+    if (x & 0x80000000UL) /* Sign extend? */
+        return x | ~0xffffffffUL;
+    return x;
+}
+
+float
+conv_f32(unsigned long x)
+{
+    union {
+        uint32_t i;
+        float f;
+    } conv;
+    conv.i = x;
+    return conv.f;
+}
+
+int
+reader_init(struct reader *r, const unsigned char *buf, unsigned long len)
+{
+    static char msg[64];
+    unsigned long bini, vers, textoff;
+
+    r->buf = buf;
+    r->nentry = 0;
+    r->err = 0;
+    if (len < 12) {
+        sprintf(msg, "input is too short: %lu bytes", len);
+        r->err = msg;
+        return -1;
+    }
+    bini    = parse_u32(buf + 0);
+    vers    = parse_u32(buf + 4);
+    textoff = parse_u32(buf + 8);
+    if (bini != 0x494e4942UL) {
+        sprintf(msg, "unknown input format (bad magic): 0x%08lx", bini);
+        r->err = msg;
+    } else if (vers != 0x00000001UL) {
+        sprintf(msg, "unknown input format (bad version): %lu", vers);
+        r->err = msg;
+    } else if (textoff > len) {
+        sprintf(msg, "unknown input format (bad text offset): %lu", textoff);
+        r->err = msg;
+    } else if (textoff < len && buf[len - 1] != 0) {
+        r->err = "invalid input (unterminated text segment)";
+    }
+    if (r->err)
+        return -1;
+    r->p = buf + 12;
+    r->text = buf + textoff;
+    r->textlen = len - textoff;
+    return 0;
+}
+
+int
+reader_section(struct reader *r, unsigned *name, unsigned *nentry)
+{
+    const unsigned char *values;
+    unsigned key;
+    int nvalue, e;
+
+    /* Skip the rest of the current section */
+    while ((e = reader_entry(r, &key, &nvalue, &values)) == 1)
+        ;
+    if (e < 0)
+        return -1;
+
+    if (r->p >= r->text - 3)
+        return 0;
+    *name = parse_u16(r->p + 0);
+    *nentry = r->nentry = parse_u16(r->p + 2);
+    r->p += 4;
+    if (*name >= r->textlen) {
+        r->err = "invalid section text offset, aborting";
+        return -1;
+    }
+    return 1;
+}
+
+int
+reader_entry(struct reader *r, unsigned *name, int *nvalue,
+             const unsigned char **values)
+{
+    if (!r->nentry)
+        return 0;
+
+    /* is there enough room for this entry? */
+    if (r->p > r->text - 3) {
+        r->err = "truncated entry, aborting";
+        return -1;
+    }
+
+    /* parse entry struct */
+    *name = parse_u16(r->p);
+    *nvalue = r->p[2];
+    r->p += 3;
+
+    /* validate entry struct */
+    if (*name >= r->textlen) {
+        r->err = "invalid entry text offset, aborting";
+        return -1;
+    }
+    if (*nvalue * 5UL > (unsigned long)(r->text - r->p)) {
+        r->err = "truncated entry value, aborting";
+        return -1;
+    }
+
+    *values = r->p;
+    r->p += *nvalue * 5;
+    r->nentry--;
+    return 1;
+}
+
+int
+reader_value(struct reader *r, const unsigned char *v, unsigned long *val)
+{
+    static char msg[32];
+    *val = parse_u32(v + 1);
+    switch (v[0]) {
+        case VALUE_INTEGER:
+        case VALUE_FLOAT:
+            return v[0];
+        case VALUE_STRING:
+            if (*val >= r->textlen) {
+                r->err = "invalid value text offset, aborting";
+                return -1;
+            }
+            return v[0];
+    }
+    sprintf(msg, "bad value type, %d", v[0]);
+    r->err = msg;
+    return -1;
+}
+
+void
+matcher_init(struct matcher *m, const char *name)
+{
+    m->name = name;
+    m->len = name ? strlen(name) : 0;
+    m->prefix = m->len && name[m->len - 1] == '*';
+    if (m->prefix)
+        m->len--;
+    m->memo = 0;
+    m->memolen = 0;
+}
+
+int
+matcher_reset(struct matcher *m, unsigned long textlen)
+{
+    /* Names are 16-bit offsets */
+    unsigned long n = textlen < 65536 ? textlen : 65536;
+    if (!m->name)
+        return 0;
+    if (n > m->memolen) {
+        unsigned char *memo = realloc(m->memo, n);
+        if (!memo)
+            return -1;
+        m->memo = memo;
+        m->memolen = n;
+    }
+    memset(m->memo, MATCH_UNKNOWN, n);
+    return 0;
+}
+
+int
+matcher_test(struct matcher *m, const unsigned char *text, unsigned offset)
+{
+    if (!m->name)
+        return 1;
+    if (m->memo[offset] == MATCH_UNKNOWN) {
+        int r;
+        if (m->prefix)
+            r = strncmp((char *)text + offset, m->name, m->len);
+        else
+            r = strcmp((char *)text + offset, m->name);
+        m->memo[offset] = r ? MATCH_NO : MATCH_YES;
+    }
+    return m->memo[offset] == MATCH_YES;
+}
+
+int
+query_parse(struct query *q, char *arg)
+{
+    char *key = strchr(arg, '/');
+    q->index = -1;
+    if (key) {
+        char *open;
+        *key++ = 0;
+        open = strchr(key, '[');
+        if (open) {
+            char *end;
+            size_t len = strlen(open);
+            if (len < 3 || open[len - 1] != ']')
+                return -1;
+            q->index = strtol(open + 1, &end, 10);
+            if (end != open + len - 1 || q->index < 0 || q->index > 254)
+                return -1;
+            *open = 0;
+        }
+    }
+    matcher_init(&q->section, arg);
+    matcher_init(&q->key, key);
+    return 0;
+}
+
+#endif
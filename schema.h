@@ -0,0 +1,196 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+/* Value type schemas for -t
+ *
+ * A schema declares the value types of entries, so that each value is
+ * parsed straight into its declared type instead of being classified
+ * by trial, and a value that doesn't fit is an error rather than a
+ * silent change of type. Each line holds a SECTION/KEY pattern and a
+ * type sequence, with comments beginning with ';' as in INI:
+ *
+ *     Good/nickname  s      ; always a string, even if it looks numeric
+ *     Good/price     i
+ *     Object/pos     fff
+ *     Ship/ids_*     i*     ; any number of integers, even none
+ *
+ * A name ending in '*' matches by prefix, as in unbini queries. The
+ * types are 'i' for integer, 'f' for float, and 's' for string, and as
+ * in a regular expression, a trailing '*' lets the last type repeat any
+ * number of times, including none. The first pattern matching an entry
+ * applies, and entries matching none are classified as usual. Names
+ * are compared as parsed, after quotes and surrounding white space are
+ * removed. Requires common.h and reader.h.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+struct rule {
+    const char *section, *key;  /* views into the schema text */
+    size_t sectionlen, keylen;
+    int sectionprefix, keyprefix;
+    char types[256];            /* a VALUE_* per value */
+    int ntypes;
+    int repeat;                 /* last type repeats, or is absent */
+};
+
+struct schema {
+    char *text;                 /* entire schema file, salts cache keys */
+    struct rule *rules;
+    long nrule;
+    struct rule **active;       /* rules for the current section */
+    long nactive;
+};
+
+/* Does the name of length LEN at S match the pattern? */
+static int
+schema_match(const char *pattern, size_t plen, int prefix,
+             const char *s, size_t len)
+{
+    if (prefix)
+        return len >= plen && !memcmp(s, pattern, plen);
+    return len == plen && !memcmp(s, pattern, plen);
+}
+
+/* Parse the pattern and types of one schema line into a rule.
+ * Returns an error message, or null on success.
+ */
+static const char *
+schema_rule(struct rule *r, char *pattern, const char *types)
+{
+    char *key = strchr(pattern, '/');
+    if (!key || key == pattern || !key[1])
+        return "expected a SECTION/KEY pattern";
+    *key++ = 0;
+    r->section = pattern;
+    r->sectionlen = strlen(pattern);
+    r->sectionprefix = pattern[r->sectionlen - 1] == '*';
+    r->sectionlen -= r->sectionprefix;
+    r->key = key;
+    r->keylen = strlen(key);
+    r->keyprefix = key[r->keylen - 1] == '*';
+    r->keylen -= r->keyprefix;
+
+    r->ntypes = 0;
+    r->repeat = 0;
+    for (; *types; types++) {
+        int type;
+        switch (*types) {
+            case 'i': type = VALUE_INTEGER; break;
+            case 'f': type = VALUE_FLOAT; break;
+            case 's': type = VALUE_STRING; break;
+            case '*':
+                if (!r->ntypes || types[1])
+                    return "'*' must follow the last type";
+                r->repeat = 1;
+                continue;
+            default:
+                return "unknown type, expected 'i', 'f', or 's'";
+        }
+        if (r->ntypes == 255)
+            return "too many types";
+        r->types[r->ntypes++] = (char)type;
+    }
+    return 0;
+}
+
+/* Load a schema file, exiting on any error.
+ */
+static struct schema *
+schema_load(const char *path)
+{
+    long line = 0;
+    unsigned long len;
+    char *p, *next;
+    struct schema *s = xmalloc(sizeof(*s));
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        fatal("%s: %s", strerror(errno), path);
+    s->text = slurp(f, &len);
+    s->text[len] = 0;  /* slurp() always leaves room */
+    fclose(f);
+    if (strlen(s->text) != len)
+        fatal("%s: invalid NUL byte", path);
+
+    /* The rules refer into a copy, split in place */
+    p = xmalloc(len + 1);
+    memcpy(p, s->text, len + 1);
+    s->rules = 0;
+    s->nrule = 0;
+    for (; p; p = next) {
+        const char *msg;
+        char *pattern, *types, *extra;
+        line++;
+        next = strchr(p, '\n');
+        if (next)
+            *next++ = 0;
+        if (strchr(p, ';'))
+            *strchr(p, ';') = 0;
+        pattern = strtok(p, " \f\r\t\v");
+        if (!pattern)
+            continue;
+        types = strtok(0, " \f\r\t\v");
+        extra = strtok(0, " \f\r\t\v");
+        if (!types || extra)
+            fatal("%s:%ld: expected a pattern and a type sequence",
+                  path, line);
+        s->rules = xreallocarray(s->rules, s->nrule + 1, sizeof(*s->rules));
+        msg = schema_rule(s->rules + s->nrule++, pattern, types);
+        if (msg)
+            fatal("%s:%ld: %s", path, line, msg);
+    }
+    s->active = xreallocarray(0, s->nrule + 1, sizeof(*s->active));
+    s->nactive = 0;
+    return s;
+}
+
+/* Select the rules that may apply to the entries of a section.
+ */
+static void
+schema_section(struct schema *s, const char *name, size_t len)
+{
+    long i;
+    s->nactive = 0;
+    for (i = 0; i < s->nrule; i++) {
+        struct rule *r = s->rules + i;
+        if (schema_match(r->section, r->sectionlen, r->sectionprefix,
+                         name, len))
+            s->active[s->nactive++] = r;
+    }
+}
+
+/* Find the rule for an entry of the current section, if any.
+ */
+static const struct rule *
+schema_entry(const struct schema *s, const char *name, size_t len)
+{
+    long i;
+    for (i = 0; i < s->nactive; i++) {
+        const struct rule *r = s->active[i];
+        if (schema_match(r->key, r->keylen, r->keyprefix, name, len))
+            return r;
+    }
+    return 0;
+}
+
+/* The declared type of value INDEX, or zero if there are too many.
+ */
+static int
+schema_type(const struct rule *r, int index)
+{
+    if (index < r->ntypes)
+        return r->types[index];
+    return r->repeat ? r->types[r->ntypes - 1] : 0;
+}
+
+/* The fewest values an entry may have. */
+static int
+schema_minimum(const struct rule *r)
+{
+    return r->ntypes - r->repeat;
+}
+
+#endif
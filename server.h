@@ -0,0 +1,188 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/* Conversion server over a Unix domain socket (POSIX only)
+ *
+ * Each connection carries one request and one response:
+ *
+ *   request:  file name (null-terminated), u32 length, payload
+ *   response: u8 status, u32 length, output, u32 length, diagnostics
+ *
+ * with a status of zero on success. The file name is only used in
+ * diagnostics. The tools report errors by exiting, so every request is
+ * served by a forked child of the listening process, with the response
+ * sent from an exit handler. The child starts warm, and a failed
+ * conversion only ends that child. Requires common.h, and a definition
+ * of _POSIX_C_SOURCE ahead of all includes.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef void (*serve_handler)(const char *name, char *buf, unsigned long len,
+                              FILE *out);
+
+static int serve_fd = -1;
+static int serve_ok;
+static FILE *serve_out;
+static FILE *serve_err;
+
+static int
+serve_read(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len) {
+        ssize_t r = read(fd, p, len);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+static int
+serve_write(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len) {
+        ssize_t r = write(fd, p, len);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+/* Send a captured stream as a length-prefixed block.
+ */
+static void
+serve_send(FILE *f)
+{
+    unsigned char n[4];
+    char buf[1 << 14];
+    long len;
+    size_t r;
+
+    fflush(f);
+    len = ftell(f);
+    n[0] = (unsigned char)(len >>  0);
+    n[1] = (unsigned char)(len >>  8);
+    n[2] = (unsigned char)(len >> 16);
+    n[3] = (unsigned char)(len >> 24);
+    serve_write(serve_fd, n, 4);
+    rewind(f);
+    while ((r = fread(buf, 1, sizeof(buf), f)))
+        serve_write(serve_fd, buf, r);
+}
+
+/* Exit handler responding to the client, however the child exits.
+ */
+static void
+serve_reply(void)
+{
+    unsigned char status = !serve_ok;
+    if (serve_fd == -1)
+        return;
+    serve_write(serve_fd, &status, 1);
+    if (serve_ok) {
+        serve_send(serve_out);
+    } else {
+        serve_write(serve_fd, "\0\0\0\0", 4);
+    }
+    serve_send(serve_err);
+    close(serve_fd);
+    serve_fd = -1;
+}
+
+static void
+serve_child(int fd, serve_handler handler)
+{
+    char name[4096];
+    unsigned char n[4];
+    unsigned long len;
+    char *buf;
+    size_t i;
+
+    for (i = 0; i < sizeof(name); i++)
+        if (serve_read(fd, name + i, 1) || !name[i])
+            break;
+    if (i == sizeof(name) || name[i] || serve_read(fd, n, 4))
+        exit(EXIT_FAILURE);
+    len = (unsigned long)n[0] <<  0 | (unsigned long)n[1] <<  8 |
+          (unsigned long)n[2] << 16 | (unsigned long)n[3] << 24;
+    buf = xmalloc(len + 1);
+    if (serve_read(fd, buf, len))
+        exit(EXIT_FAILURE);
+
+    /* Capture output and diagnostics for the response */
+    serve_out = tmpfile();
+    serve_err = tmpfile();
+    if (!serve_out || !serve_err)
+        exit(EXIT_FAILURE);
+    fflush(stderr);
+    dup2(fileno(serve_err), 2);
+    serve_fd = fd;
+    atexit(serve_reply);
+
+    handler(name, buf, len, serve_out);
+    serve_ok = 1;
+    exit(EXIT_SUCCESS);
+}
+
+/* Listen on the socket at PATH forever, serving each request with
+ * HANDLER, which reports errors by exiting.
+ */
+static void
+serve(const char *path, serve_handler handler)
+{
+    int fd;
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        fatal("%s: socket path too long", path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        fatal("socket: %s", strerror(errno));
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64))
+        fatal("%s: %s", strerror(errno), path);
+
+    /* Children are never waited for */
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        pid_t pid;
+        int c = accept(fd, 0, 0);
+        if (c == -1) {
+            if (errno == EINTR)
+                continue;
+            fatal("accept: %s", strerror(errno));
+        }
+        fflush(stdout);
+        fflush(stderr);
+        pid = fork();
+        if (pid == -1)
+            fatal("fork: %s", strerror(errno));
+        if (!pid) {
+            close(fd);
+            serve_child(c, handler);
+        }
+        close(c);
+    }
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+
+/* Conversion statistics for -s
+ *
+ * Wall-clock time is charged to phases with stats_lap(), which adds
+ * the time since the previous lap to a phase total, so that phases
+ * which interleave, such as parsing and interning, are still told
+ * apart. Everything is a no-op until stats_start() is called.
+ * Results are printed to standard error as key=value lines.
+ *
+ * The POSIX clock and getrusage() need _POSIX_C_SOURCE, defined before
+ * any header is included. Elsewhere clock() stands in, which measures
+ * wall-clock time on Windows, and peak RSS is not reported. Requires
+ * common.h for the allocation counters.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#  include <sys/resource.h>
+#endif
+
+static int stats_enabled;
+static double stats_mark;
+
+#if defined(__unix__) || defined(__APPLE__)
+static double
+stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#else
+static double
+stats_now(void)
+{
+    return clock() / (double)CLOCKS_PER_SEC;
+}
+#endif
+
+static void
+stats_start(void)
+{
+    stats_enabled = 1;
+    stats_mark = stats_now();
+}
+
+/* Charge the time since the last lap to PHASE. */
+static void
+stats_lap(double *phase)
+{
+    if (stats_enabled) {
+        double now = stats_now();
+        *phase += now - stats_mark;
+        stats_mark = now;
+    }
+}
+
+static void
+stats_time(const char *phase, double seconds)
+{
+    fprintf(stderr, "time_%s=%.6f\n", phase, seconds);
+}
+
+static void
+stats_count(const char *key, unsigned long n)
+{
+    fprintf(stderr, "%s=%lu\n", key, n);
+}
+
+/* Print peak RSS and the xmalloc() totals. */
+static void
+stats_memory(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage ru;
+    if (!getrusage(RUSAGE_SELF, &ru)) {
+#  ifdef __APPLE__
+        stats_count("peak_rss_kb", (unsigned long)ru.ru_maxrss / 1024);
+#  else
+        stats_count("peak_rss_kb", (unsigned long)ru.ru_maxrss);
+#  endif
+    }
+#endif
+    stats_count("alloc_count", alloc_count);
+    stats_count("alloc_bytes", alloc_bytes);
+}
+
+#endif
@@ -0,0 +1,74 @@
+#!/bin/sh -e
+
+# Throughput benchmark over generated corpora
+#
+#   SIZES      corpus sizes in kilobytes (default: "256 4096")
+#   REPEAT     runs per measurement, the fastest is kept (default: 3)
+#   BASELINE   results to compare against (default: bench.baseline)
+#   TOLERANCE  slowdown in percent reported as a regression (default: 10)
+#
+# Results are written to bench.out, which may be copied to
+# bench.baseline to compare later runs against it.
+
+BINI="$RUN ../bini"
+UNBINI="$RUN ../unbini"
+GENCORPUS="$RUN ./gencorpus"
+STOPWATCH="$RUN ./stopwatch"
+TRIEBENCH="$RUN ./triebench"
+
+KINDS="float string sections huge suffix"
+SIZES=${SIZES:-"256 4096"}
+REPEAT=${REPEAT:-3}
+BASELINE=${BASELINE:-bench.baseline}
+TOLERANCE=${TOLERANCE:-10}
+
+# Print a result line and record it: corpus phase bytes entries seconds
+report() {
+    awk -v name="$1" -v phase="$2" -v bytes="$3" -v n="$4" -v t="$5" \
+        'BEGIN { if (t < 1e-6) t = 1e-6
+                 printf "%-16s %-8s %10.2f %12.0f\n",
+                        name, phase, bytes / 1048576 / t, n / t }' \
+        | tee -a bench.out
+}
+
+rm -f bench.out bench.tmp.trie
+printf '%-16s %-8s %10s %12s\n' corpus phase MB/s entries/s
+for size in $SIZES; do
+    for kind in $KINDS; do
+        name=$kind-$size
+        $GENCORPUS $kind $size >bench.tmp.ini
+        $BINI -o bench.tmp.bini bench.tmp.ini
+        text=$(wc -c <bench.tmp.ini)
+        binary=$(wc -c <bench.tmp.bini)
+        entries=$(grep -c = bench.tmp.ini)
+
+        t=$($STOPWATCH $REPEAT "$BINI -o bench.tmp.out bench.tmp.ini")
+        report $name bini $text $entries $t
+        t=$($STOPWATCH $REPEAT "$BINI -c bench.tmp.ini")
+        report $name bini-c $text $entries $t
+        t=$($STOPWATCH $REPEAT "$UNBINI -o bench.tmp.out bench.tmp.bini")
+        report $name unbini $binary $entries $t
+
+        $TRIEBENCH $name bench.tmp.ini >>bench.tmp.trie
+    done
+done
+
+# String table microbenchmark, per key
+printf '\n%-16s %8s %10s %10s %10s %10s\n' \
+       corpus keys KB insert-ns search-ns visit-ns
+cat bench.tmp.trie
+rm -f bench.tmp.ini bench.tmp.bini bench.tmp.out bench.tmp.trie
+
+# Compare throughput against the baseline
+if [ -f "$BASELINE" ]; then
+    awk -v tolerance=$TOLERANCE '
+        NR == FNR { base[$1 " " $2] = $3; next }
+        ($1 " " $2) in base {
+            change = ($3 / base[$1 " " $2] - 1) * 100
+            if (change < -tolerance) {
+                printf "regression: %s %s %.1f%%\n", $1, $2, change
+                bad = 1
+            }
+        }
+        END { exit bad }' "$BASELINE" bench.out >&2
+fi
@@ -0,0 +1,66 @@
+#!/bin/sh -e
+
+# Worst-case scaling checks over adversarial corpora
+#
+# Each corpus is converted at a base size and at FACTOR times that
+# size. Linear work takes about FACTOR times as long, and quadratic
+# work FACTOR squared, so anything slowing down by more than twice
+# FACTOR fails. Times under FLOOR seconds are mostly process startup
+# and are rounded up to it.
+#
+#   SIZE    base corpus size in kilobytes (default: 1024)
+#   REPEAT  runs per measurement, the fastest is kept (default: 3)
+
+BINI="$RUN ../bini"
+UNBINI="$RUN ../unbini"
+GENCORPUS="$RUN ./gencorpus"
+STOPWATCH="$RUN ./stopwatch"
+
+KINDS="quotes nested entries huge suffix"
+SIZE=${SIZE:-1024}
+REPEAT=${REPEAT:-3}
+FACTOR=4
+FLOOR=0.01
+
+fail=0
+total=0
+
+# Time a command at both sizes: phase command-with-FILE
+measure() {
+    small=$($STOPWATCH $REPEAT "$(printf "$2" complexity.tmp.small)")
+    large=$($STOPWATCH $REPEAT "$(printf "$2" complexity.tmp.large)")
+    if ! awk -v kind=$kind -v phase=$1 -v a=$small -v b=$large \
+             -v factor=$FACTOR -v floor=$FLOOR '
+             BEGIN { ratio = b / (a > floor ? a : floor)
+                     printf "%-8s %-8s %8.3fs %8.3fs %6.1fx\n",
+                            kind, phase, a, b, ratio
+                     exit ratio > 2 * factor }'; then
+        printf 'superlinear: %s %s\n' $kind $1 1>&2
+        fail=$((fail + 1))
+    fi
+    total=$((total + 1))
+}
+
+printf '%-8s %-8s %9s %9s %7s\n' corpus phase small large ratio
+for kind in $KINDS; do
+    $GENCORPUS $kind $SIZE >complexity.tmp.small
+    $GENCORPUS $kind $((SIZE * FACTOR)) >complexity.tmp.large
+    measure bini "$BINI -o complexity.tmp.out %s"
+    measure bini-c "$BINI -c %s"
+
+    $BINI -o complexity.tmp.small.bini complexity.tmp.small
+    $BINI -o complexity.tmp.large.bini complexity.tmp.large
+    measure unbini "$UNBINI -o complexity.tmp.out %s.bini"
+done
+rm -f complexity.tmp.*
+
+# Print report
+if [ $fail -eq 0 ]; then
+    printf '\033[1;92mPASS\033[0m'
+    code=0
+else
+    printf '\033[1;91mFAIL\033[0m'
+    code=1
+fi
+printf ': %d / %d\n' $((total - fail)) $total
+exit $code
@@ -0,0 +1,301 @@
+/* Generate a deterministic synthetic INI corpus for benchmarking
+ *
+ * usage: gencorpus KIND KILOBYTES
+ *
+ * Writes roughly KILOBYTES of text INI to standard output, shaped after
+ * the game's own data files. The output depends only on the arguments,
+ * and every corpus converts without overflowing the string table.
+ *
+ *   float     positions, rotations and other float tuples
+ *   string    nicknames and references drawn from a large vocabulary
+ *   sections  many tiny sections
+ *   huge      entries with the maximum of 255 values
+ *   suffix    strings that are mostly suffixes of one another
+ *
+ * A few more kinds are adversarial, built to expose superlinear work:
+ *
+ *   quotes    long quoted strings made entirely of escaped quotes
+ *   nested    a long chain of nested suffixes, then many references
+ *             to the innermost ones
+ *   entries   sections with the maximum of 65535 entries
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const sections[] = {
+    "Object", "Zone", "Ship", "Good", "Equipment", "Base", "Room",
+    "System", "Faction", "Light", "Engine", "Power", "Shield", "Gun",
+    "Munition", "Motor", "Explosion", "Asteroids", "Nebula", "Archetype"
+};
+
+static const char *const keys[] = {
+    "nickname", "ids_name", "ids_info", "pos", "rotate", "archetype",
+    "reputation", "behavior", "spin", "size", "shape", "property_flags",
+    "visit", "goto", "loadout", "pilot", "difficulty_level", "msg_id_prefix",
+    "jump_effect", "dock_with", "base", "parent", "atmosphere_range",
+    "burn_color", "ambient_color", "mass", "hit_pts", "explosion_resistance",
+    "volume", "price", "lod_ranges", "material_library", "da_archetype"
+};
+
+static const char *const syllables[] = {
+    "li", "br", "ku", "rh", "ew", "iw", "bw", "hi", "st", "fp", "ga",
+    "co", "ge", "ri", "ta", "mo", "ne", "xa", "vo", "pe", "lu", "da"
+};
+
+static const char *const tails[] = {
+    "trade_lane_ring", "jump_hole", "jump_gate", "planet", "station",
+    "docking_ring", "weapon_platform", "asteroid_field", "nebula_zone",
+    "depot", "outpost", "battleship"
+};
+
+static unsigned long rng = 1;
+
+/* 32-bit xorshift, identical on every host */
+static unsigned long
+next(void)
+{
+    rng ^= (rng << 13) & 0xffffffffUL;
+    rng ^= rng >> 17;
+    rng ^= (rng << 5) & 0xffffffffUL;
+    return rng;
+}
+
+static unsigned long
+range(unsigned long n)
+{
+    return next() % n;
+}
+
+static unsigned long target;
+static unsigned long written;
+
+static void
+emit(const char *s)
+{
+    written += (unsigned long)strlen(s);
+    fputs(s, stdout);
+}
+
+static void
+emit_section(const char *name)
+{
+    char buf[64];
+    sprintf(buf, "[%s]\n", name);
+    emit(buf);
+}
+
+static void
+emit_float(void)
+{
+    static const unsigned long scale[] = {10, 100, 1000, 10000};
+    char buf[32];
+    int digits = (int)range(4);
+    long whole = (long)range(200000) - 100000;
+    sprintf(buf, "%ld.%0*lu", whole, digits + 1, range(scale[digits]));
+    emit(buf);
+}
+
+static void
+emit_int(void)
+{
+    char buf[32];
+    sprintf(buf, "%ld", (long)range(2000000) - 1000000);
+    emit(buf);
+}
+
+/* A nickname from a vocabulary of 22 * 22 * 4 words. */
+static void
+emit_name(void)
+{
+    char buf[64];
+    unsigned long i = range(22 * 22 * 4);
+    sprintf(buf, "%s%s%lu_%s", syllables[i % 22], syllables[i / 22 % 22],
+            i / 484, keys[i % 33]);
+    emit(buf);
+}
+
+/* Strings sharing a handful of tails, so that many are suffixes of
+ * others: "li03_trade_lane_ring", "03_trade_lane_ring", etc.
+ */
+static void
+emit_suffixed(void)
+{
+    char buf[64];
+    const char *tail = tails[range(12)];
+    unsigned long n = range(10);
+    switch (range(3)) {
+        case 0: sprintf(buf, "%s", tail); break;
+        case 1: sprintf(buf, "%02lu_%s", n, tail); break;
+        case 2: sprintf(buf, "%s%02lu_%s", syllables[range(12)], n, tail);
+    }
+    emit(buf);
+}
+
+static void
+emit_entry(const char *key, void (*value)(void), int nvalue)
+{
+    int i;
+    emit(key);
+    emit(" = ");
+    for (i = 0; i < nvalue; i++) {
+        if (i)
+            emit(", ");
+        value();
+    }
+    emit("\n");
+}
+
+static void
+gen_float(void)
+{
+    int i, n = (int)range(30) + 10;
+    emit_section(sections[range(20)]);
+    for (i = 0; i < n; i++)
+        emit_entry(keys[range(33)], emit_float, (int)range(4) + 1);
+}
+
+static void
+gen_string(void)
+{
+    int i, n = (int)range(30) + 10;
+    emit_section(sections[range(20)]);
+    for (i = 0; i < n; i++)
+        emit_entry(keys[range(33)], emit_name, (int)range(3) + 1);
+}
+
+static void
+gen_sections(void)
+{
+    emit_section(sections[range(20)]);
+    emit_entry("nickname", emit_name, 1);
+    if (range(2))
+        emit_entry(keys[range(33)], emit_int, 1);
+}
+
+static void
+gen_huge(void)
+{
+    int i, n = (int)range(4) + 1;
+    emit_section(sections[range(20)]);
+    for (i = 0; i < n; i++)
+        emit_entry(keys[range(33)], range(2) ? emit_float : emit_int, 255);
+}
+
+static void
+gen_suffix(void)
+{
+    int i, n = (int)range(30) + 10;
+    emit_section(sections[range(20)]);
+    for (i = 0; i < n; i++)
+        emit_entry(keys[range(33)], emit_suffixed, (int)range(3) + 1);
+}
+
+static void
+gen_quotes(void)
+{
+    int i;
+    unsigned long j, n = target / 256 < 60000 ? target / 256 + 1 : 60000;
+    emit_section("Quotes");
+    for (i = 0; i < 4; i++) {
+        emit("text = \"");
+        for (j = 0; j < n; j++)
+            emit("\"\"");
+        emit("\"\n");
+    }
+}
+
+/* Every suffix of one string, longest last, so that each is the parent
+ * of the previous one in the string table, followed by references to
+ * the shortest suffixes, which sit deepest in that chain.
+ */
+static void
+gen_nested(void)
+{
+    static char chain[30001];
+    static unsigned long len, next;
+    int i, j;
+
+    if (!len) {
+        while (len < 30000 && (len + 1) * (len + 1) <= target)
+            len++;
+        for (j = 0; j < (int)len; j++)
+            chain[j] = "abcdefghijklmnopqrstuvwxyz"[j % 26];
+    }
+
+    if (next < len) {
+        emit_section("Chain");
+        for (i = 0; i < 16 && next < len; i++) {
+            emit("link = ");
+            emit(chain + len - ++next);
+            emit("\n");
+        }
+    } else {
+        emit_section("Refs");
+        for (i = 0; i < 32; i++) {
+            emit("ref = ");
+            for (j = 1; j <= 8 && j <= (int)len; j++) {
+                emit(j > 1 ? ", " : "");
+                emit(chain + len - j);
+            }
+            emit("\n");
+        }
+    }
+}
+
+static void
+gen_entries(void)
+{
+    long i;
+    emit_section("Entries");
+    for (i = 0; i < 65535 && written < target; i++)
+        emit("k = 1\n");
+}
+
+static const struct {
+    const char *name;
+    void (*gen)(void);
+} kinds[] = {
+    {"float",    gen_float},
+    {"string",   gen_string},
+    {"sections", gen_sections},
+    {"huge",     gen_huge},
+    {"suffix",   gen_suffix},
+    {"quotes",   gen_quotes},
+    {"nested",   gen_nested},
+    {"entries",  gen_entries}
+};
+
+int
+main(int argc, char **argv)
+{
+    int i;
+
+    if (argc != 3) {
+        fputs("usage: gencorpus KIND KILOBYTES\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    target = strtoul(argv[2], 0, 10) * 1024;
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        _setmode(_fileno(stdout), 0x8000);
+    }
+#endif
+
+    for (i = 0; i < (int)(sizeof(kinds) / sizeof(*kinds)); i++) {
+        if (!strcmp(kinds[i].name, argv[1])) {
+            rng = 0x2545f491UL + (unsigned long)i;
+            while (written < target)
+                kinds[i].gen();
+            if (fflush(stdout)) {
+                fputs("gencorpus: output error\n", stderr);
+                exit(EXIT_FAILURE);
+            }
+            return 0;
+        }
+    }
+    fprintf(stderr, "gencorpus: unknown kind: %s\n", argv[1]);
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,77 @@
+/* Rebuild a BINI file through builder.h
+ *
+ * usage: rebuild <BINI >BINI
+ *
+ * Replays every section, entry, and value of a BINI file on standard
+ * input through the builder and writes the result. For anything bini
+ * wrote, the output must be identical to the input.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PROGRAM_NAME "rebuild"
+
+#include "../common.h"
+#include "../builder.h"
+#include "../reader.h"
+
+int
+main(void)
+{
+    int e, nvalue;
+    unsigned long len;
+    unsigned name, nentry, key;
+    const unsigned char *values;
+    unsigned char *buf;
+    struct reader r;
+    struct builder *b;
+
+    (void)version;  /* from common.h, unused here */
+
+#ifdef _WIN32
+    {
+        int _setmode(int, int);
+        _setmode(_fileno(stdout), 0x8000);
+        _setmode(_fileno(stdin), 0x8000);
+    }
+#endif
+
+    buf = slurp(stdin, &len);
+    if (reader_init(&r, buf, len))
+        fatal("%s", r.err);
+
+    b = builder_create();
+    while ((e = reader_section(&r, &name, &nentry)) == 1) {
+        builder_section(b, (char *)r.text + name);
+        while ((e = reader_entry(&r, &key, &nvalue, &values)) == 1) {
+            int j;
+            builder_entry(b, (char *)r.text + key);
+            for (j = 0; j < nvalue; j++) {
+                unsigned long val;
+                switch (reader_value(&r, values + j * 5, &val)) {
+                    case VALUE_INTEGER:
+                        builder_int(b, conv_s32(val));
+                        break;
+                    case VALUE_FLOAT:
+                        builder_float(b, conv_f32(val));
+                        break;
+                    case VALUE_STRING:
+                        builder_string(b, (char *)r.text + val);
+                        break;
+                    default:
+                        fatal("%s", r.err);
+                }
+            }
+        }
+        if (e < 0)
+            break;
+    }
+    if (e < 0)
+        fatal("%s", r.err);
+
+    builder_finish(b, stdout);
+    free(buf);
+    if (fflush(stdout))
+        fatal("output error");
+    return 0;
+}
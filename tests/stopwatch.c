@@ -0,0 +1,57 @@
+/* Time a shell command
+ *
+ * usage: stopwatch REPEAT COMMAND
+ *
+ * Runs COMMAND through system() REPEAT times and prints the fastest
+ * wall-clock time in seconds. The minimum is the figure least disturbed
+ * by whatever else the machine is doing. Fails if any run fails.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#  define _POSIX_C_SOURCE 200112L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#else
+/* On Windows clock() measures wall-clock time */
+static double
+now(void)
+{
+    return clock() / (double)CLOCKS_PER_SEC;
+}
+#endif
+
+int
+main(int argc, char **argv)
+{
+    long i, repeat;
+    double best = -1;
+
+    if (argc != 3 || (repeat = strtol(argv[1], 0, 10)) < 1) {
+        fputs("usage: stopwatch REPEAT COMMAND\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < repeat; i++) {
+        double start = now();
+        double t;
+        if (system(argv[2])) {
+            fprintf(stderr, "stopwatch: command failed: %s\n", argv[2]);
+            exit(EXIT_FAILURE);
+        }
+        t = now() - start;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    printf("%.6f\n", best);
+    return 0;
+}
@@ -2,10 +2,51 @@
 
 BINI="$RUN ../bini"
 UNBINI="$RUN ../unbini"
+REPACK="$RUN ../binirepack"
+GREP="$RUN ../binigrep"
+PATCH="$RUN ../binipatch"
+COL="$RUN ../binicol"
+DIFF="$RUN ../binidiff"
+MERGE="$RUN ../binimerge"
+ARC="$RUN ../biniarc"
+CLIENT="$RUN ../biniclient"
+
+# Statistics that vary from run to run, or between bini and unbini
+TIMINGS="-e ^time_ -e ^peak_ -e ^alloc_ -e ^input_"
 
 fail=0
 total=0
 
+# Check that a command's output or status was as expected
+expect() {
+    if [ ! "$2" = "$3" ]; then
+        printf '%s: expected "%s", got "%s"\n' "$1" "$3" "$2" 1>&2
+        fail=$((fail + 1))
+    fi
+    total=$((total + 1))
+}
+
+# Print the exit status and diagnostics of a command
+diagnose() {
+    status=0
+    err=$("$@" 2>&1 >/dev/null) || status=$?
+    printf '%s:%s' $status "$err"
+}
+
+# Start a conversion server on server.tmp, succeeding once it listens
+serve() {
+    rm -f server.tmp
+    "$@" -S server.tmp 2>/dev/null &
+    server=$!
+    for i in 1 2 3 4 5; do
+        [ -S server.tmp ] && return 0
+        kill -0 $server 2>/dev/null || return 1
+        sleep 1
+    done
+    kill $server
+    return 1
+}
+
 # Test valid inputs
 for ini in valid/*; do
     $BINI $ini 1>/dev/null 2>/dev/null && true;
@@ -13,9 +54,43 @@ for ini in valid/*; do
         0)  # expected: now test idempotency
             hash0=$($BINI $ini | $RUN ./fletcher64)
             hash1=$($BINI $ini | $UNBINI | $BINI | $RUN ./fletcher64)
+            hash2=$($BINI $ini | $REPACK | $RUN ./fletcher64)
+            hash3=$($BINI -i sidecar.tmp $ini | $RUN ./fletcher64)
+            hash4=$($BINI -i sidecar.tmp $ini | $RUN ./fletcher64)
+            hash5=$($BINI -s $ini 2>stats.tmp | $RUN ./fletcher64)
+            hash6=$($BINI $ini | $RUN ./rebuild | $RUN ./fletcher64)
+            hash7=$($BINI $ini | $UNBINI -m | $BINI | $RUN ./fletcher64)
+            counts=$(grep -v $TIMINGS stats.tmp)
+            $BINI -s -i sidecar.tmp $ini 2>stats.tmp >/dev/null
+            reused=$(grep -v $TIMINGS -e ^sections_reused stats.tmp)
+            $BINI $ini | $UNBINI -s 2>stats.tmp >/dev/null
             if [ ! "$hash0" = "$hash1" ]; then
                 printf 'not idempotent: %s\n' $ini 1>&2
                 fail=$((fail + 1))
+            elif ! $BINI -r $ini 2>/dev/null; then
+                printf 'round trip check failed: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$hash0" = "$hash2" ]; then
+                printf 'repack changed output: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$hash0" = "$hash3" ] || [ ! "$hash0" = "$hash4" ]; then
+                printf 'incremental changed output: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$hash0" = "$hash6" ]; then
+                printf 'builder changed output: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$hash0" = "$hash7" ]; then
+                printf 'compact text changed output: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$hash0" = "$hash5" ]; then
+                printf 'statistics changed output: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$counts" = "$(grep -v $TIMINGS stats.tmp)" ]; then
+                printf 'statistics disagree: %s\n' $ini 1>&2
+                fail=$((fail + 1))
+            elif [ ! "$counts" = "$reused" ]; then
+                printf 'incremental statistics disagree: %s\n' $ini 1>&2
+                fail=$((fail + 1))
             fi
             total=$((total + 1))
             ;;
@@ -44,6 +119,272 @@ for ini in invalid/*; do
     total=$((total + 1))
 done
 
+# Test typed parsing: the schema must give the types written out
+# explicitly in expect.ini, and reject every mismatch
+hash0=$($BINI schema/expect.ini | $RUN ./fletcher64)
+hash1=$($BINI -t schema/types schema/valid.ini | $RUN ./fletcher64)
+if [ ! "$hash0" = "$hash1" ]; then
+    printf 'schema changed output: schema/valid.ini\n' 1>&2
+    fail=$((fail + 1))
+elif ! $BINI -r -t schema/types schema/valid.ini 2>/dev/null; then
+    printf 'not idempotent with schema: schema/valid.ini\n' 1>&2
+    fail=$((fail + 1))
+fi
+total=$((total + 1))
+for ini in schema/invalid*; do
+    $BINI -t schema/types $ini 1>/dev/null 2>/dev/null && true;
+    case $? in
+        0)  printf 'not rejected: %s\n' $ini 1>&2
+            fail=$((fail + 1))
+            ;;
+        1)  ;; # expected
+        *)  printf 'crashing input: %s\n' $ini 1>&2
+            fail=$((fail + 1))
+            ;;
+    esac
+    if ! $BINI $ini 1>/dev/null 2>/dev/null; then
+        printf 'invalid without schema: %s\n' $ini 1>&2
+        fail=$((fail + 1))
+    fi
+    total=$((total + 1))
+done
+
+# Test check mode: bini -c and unbini -c must fail exactly as a full
+# conversion does, with the same status and diagnostics
+for ini in valid/* invalid/*; do
+    expect "bini -c $ini" "$(diagnose $BINI -c $ini)" "$(diagnose $BINI $ini)"
+done
+for ini in valid/*; do
+    $BINI $ini >new.tmp
+    expect "unbini -c $ini" "$(diagnose $UNBINI -c new.tmp)" \
+        "$(diagnose $UNBINI new.tmp)"
+    dd if=new.tmp of=old.tmp bs=20 count=1 2>/dev/null
+    expect "unbini -c truncated $ini" "$(diagnose $UNBINI -c old.tmp)" \
+        "$(diagnose $UNBINI old.tmp)"
+done
+expect 'bini -c BINI input' "$(diagnose $BINI -c new.tmp)" \
+    "$(diagnose $BINI new.tmp)"
+awk 'BEGIN { print "[S]"; for (i = 0; i < 8000; i++) print "k" i " = s" i }' \
+    >ini.tmp
+expect 'bini -c too many strings' "$(diagnose $BINI -c ini.tmp)" \
+    '1:bini: too many strings'
+expect 'bini too many strings' "$(diagnose $BINI ini.tmp)" \
+    '1:bini: too many strings'
+
+# Test unbini queries
+printf '[Good]\nnickname = gold\nprice = 120, 0.5\n\n[Ship]\nnickname = li_elite\n\n[Shipyard]\nnickname = yard\n\n[Empty]\n' |
+    $BINI >query.tmp
+expect 'query section' "$($UNBINI -q Good query.tmp)" \
+    "$(printf '[Good]\nnickname = gold\nprice = 120, 0.5')"
+expect 'query key' "$($UNBINI -q Good/price query.tmp)" \
+    "$(printf '[Good]\nprice = 120, 0.5')"
+expect 'query empty section' "$($UNBINI -q Empty query.tmp)" '[Empty]'
+expect 'query no match' "$($UNBINI -q Nope -q Good/nope query.tmp)" ''
+expect 'query repeated' \
+    "$($UNBINI -q Good/nickname -q Ship/nickname query.tmp)" \
+    "$(printf '[Good]\nnickname = gold\n\n[Ship]\nnickname = li_elite')"
+expect 'query prefix' "$($UNBINI -q 'Ship*' query.tmp)" \
+    "$(printf '[Ship]\nnickname = li_elite\n\n[Shipyard]\nnickname = yard')"
+expect 'query key prefix' "$($UNBINI -q 'Good/pr*' query.tmp)" \
+    "$(printf '[Good]\nprice = 120, 0.5')"
+status=0
+$UNBINI -q 'Good/price[1]' query.tmp >/dev/null 2>&1 || status=$?
+expect 'query index rejected' $status 1
+
+# Test binigrep
+printf '[Good]\nnickname = commodity_gold\nprice = 120, 0.5\n\n[Ship]\nnickname = li_elite\n' |
+    $BINI >grep.tmp
+expect 'binigrep substring' "$($GREP gold grep.tmp)" 'grep.tmp:[Good] nickname'
+expect 'binigrep whole' "$($GREP -x commodity_gold grep.tmp)" \
+    'grep.tmp:[Good] nickname'
+status=0
+out=$($GREP -x gold grep.tmp) || status=$?
+expect 'binigrep no match' "$status:$out" '1:'
+expect 'binigrep integer' "$($GREP 120 grep.tmp)" 'grep.tmp:[Good] price'
+expect 'binigrep float' "$($GREP 0.5 grep.tmp)" 'grep.tmp:[Good] price'
+expect 'binigrep list' "$($GREP -l elite grep.tmp grep.tmp)" \
+    "$(printf 'grep.tmp\ngrep.tmp')"
+status=0
+$GREP gold test.sh 2>/dev/null || status=$?
+expect 'binigrep corrupt input' $status 2
+status=0
+$GREP gold . 2>/dev/null || status=$?
+expect 'binigrep unreadable input' $status 2
+
+# A string stored beyond the first 64 KiB of the string table
+{
+    printf 'BINI\001\000\000\000\030\000\000\000'
+    printf '\000\000\001\000\002\000\001\003\163\021\001\000'  # at 70003
+    printf 'S\000k\000'
+    dd if=/dev/zero bs=69998 count=1 2>/dev/null | tr '\000' a
+    printf '\000needle\000'
+} >grep.tmp
+expect 'binigrep large table' "$($GREP needle grep.tmp)" 'grep.tmp:[S] k'
+
+# Test binicol
+printf '[Good]\nnickname = gold\nprice = 120, 0.5\n\n[Good]\nnickname = iron\nprice = 30\n' |
+    $BINI >col.tmp
+expect 'binicol column' "$($COL Good/price col.tmp)" \
+    "$(printf 'col.tmp,Good,price,120\ncol.tmp,Good,price,0.5\ncol.tmp,Good,price,30')"
+expect 'binicol index' "$($COL 'Good/price[1]' col.tmp)" \
+    'col.tmp,Good,price,0.5'
+expect 'binicol strings' "$($COL Good/nickname col.tmp)" \
+    "$(printf 'col.tmp,Good,nickname,gold\ncol.tmp,Good,nickname,iron')"
+expect 'binicol raw' "$($COL -r 'Good/price[0]' col.tmp | od -An -tx1 | tr -s ' ')" \
+    ' 78 00 00 00 1e 00 00 00'
+
+# Test binipatch: numbers keep the type already stored unless forced,
+# and strings reuse a shared suffix or are appended to the table
+printf '[Good]\nnickname = li_gold\nprice = 120, 0.5\nicon = gold\n' |
+    $BINI >patch.tmp
+size=$(wc -c <patch.tmp)
+$PATCH -s 'Good/price[1]=2' -s Good/price=7 -s Good/nickname=old patch.tmp
+expect 'binipatch coerce' "$($UNBINI patch.tmp)" \
+    "$(printf '[Good]\nnickname = old\nprice = 7, 2.\nicon = gold')"
+expect 'binipatch shared suffix' $(wc -c <patch.tmp) $size
+status=0
+$PATCH -s Good/price=2.5 patch.tmp 2>/dev/null || status=$?
+expect 'binipatch type change' $status 1
+$PATCH -f -s Good/price=2.5 patch.tmp
+$PATCH -s Good/icon=123 patch.tmp
+expect 'binipatch append' "$($UNBINI patch.tmp)" \
+    "$(printf '[Good]\nnickname = old\nprice = 2.5, 2.\nicon = "123"')"
+expect 'binipatch appended size' $(wc -c <patch.tmp) $((size + 4))
+
+# Test binidiff: 0 for the same, 1 for changed, 2 for trouble
+printf '[Good]\nnickname = gold\nprice = 120\n' | $BINI >old.tmp
+printf '[Good]\nnickname = gold\nprice = 130\nicon = x\n\n[New]\n' |
+    $BINI >new.tmp
+status=0
+out=$($DIFF old.tmp old.tmp) || status=$?
+expect 'binidiff same' "$status:$out" '0:'
+status=0
+out=$($DIFF old.tmp new.tmp) || status=$?
+expect 'binidiff changed' "$status:$out" \
+    "$(printf '1:-[Good] price = 120\n+[Good] price = 130\n+[Good] icon = "x"\n+[New]')"
+status=0
+$DIFF old.tmp missing.tmp 2>/dev/null || status=$?
+expect 'binidiff missing input' $status 2
+status=0
+$DIFF old.tmp test.sh 2>/dev/null || status=$?
+expect 'binidiff invalid input' $status 2
+
+# Test binimerge: an overlay replaces matching entries in place, while
+# -a only appends its sections
+printf '[Good]\nnickname = gold\nprice = 120\n\n[Ship]\nnickname = li\n' |
+    $BINI >old.tmp
+printf '[Good]\nprice = 130\nicon = x\n\n[New]\n' | $BINI >new.tmp
+expect 'binimerge overlay' "$($MERGE old.tmp new.tmp | $UNBINI)" \
+    "$(printf '[Good]\nnickname = gold\nprice = 130\nicon = x\n\n[Ship]\nnickname = li\n\n[New]')"
+expect 'binimerge append' "$($MERGE -a old.tmp new.tmp | $UNBINI)" \
+    "$(printf '[Good]\nnickname = gold\nprice = 120\n\n[Ship]\nnickname = li\n\n[Good]\nprice = 130\nicon = x\n\n[New]')"
+
+# Test biniarc: members come back byte for byte, despite shared strings
+$ARC -c -o arc.tmp old.tmp new.tmp
+expect 'biniarc list' "$($ARC -t arc.tmp)" "$(printf 'new.tmp\nold.tmp')"
+for name in old.tmp new.tmp; do
+    if ! $ARC -x arc.tmp $name | cmp -s - $name; then
+        printf 'biniarc extract changed member: %s\n' $name 1>&2
+        fail=$((fail + 1))
+    fi
+    total=$((total + 1))
+done
+
+# Test the conversion cache: a miss and then a hit give the same bytes
+# as a plain conversion
+mkdir -p cache.tmp
+printf '[Good]\nnickname = gold\nprice = 120, 0.5\n' >ini.tmp
+$BINI ini.tmp >old.tmp
+for run in miss hit; do
+    $BINI -C cache.tmp ini.tmp >new.tmp
+    expect "bini cache $run" "$(cmp old.tmp new.tmp && echo same)" same
+    $UNBINI -C cache.tmp old.tmp >new.tmp
+    expect "unbini cache $run" "$(cmp ini.tmp new.tmp && echo same)" same
+done
+expect 'cache entries' $(ls cache.tmp | wc -l) 2
+
+# Statistics when work is reused: a cache hit says so rather than count
+# nothing, and sections reused from a sidecar count as if parsed
+expect 'bini cache statistics' \
+    "$($BINI -s -C cache.tmp ini.tmp 2>&1 >/dev/null | grep -v $TIMINGS)" \
+    cache_hit=1
+expect 'unbini cache statistics' \
+    "$($UNBINI -s -C cache.tmp old.tmp 2>&1 >/dev/null | grep -v $TIMINGS)" \
+    cache_hit=1
+counts=$($BINI -s ini.tmp 2>&1 >/dev/null | grep -v $TIMINGS)
+rm -f sidecar.tmp
+$BINI -i sidecar.tmp ini.tmp >/dev/null
+expect 'bini sidecar statistics' \
+    "$($BINI -s -i sidecar.tmp ini.tmp 2>&1 >/dev/null | grep -v $TIMINGS)" \
+    "$(printf 'sections_reused=1\n%s' "$counts")"
+
+# Test server mode, where biniclient was built and the system has Unix
+# domain sockets: replies match plain conversions, diagnostics included
+if [ -x ../biniclient ] && serve $BINI; then
+    $CLIENT -S server.tmp ini.tmp >new.tmp
+    expect 'bini server' "$(cmp old.tmp new.tmp && echo same)" same
+    expect 'bini server invalid' \
+        "$(diagnose $CLIENT -S server.tmp invalid/000.ini)" \
+        '1:invalid/000.ini:4: invalid NUL byte'
+    kill $server
+fi
+if [ -x ../biniclient ] && serve $UNBINI; then
+    $CLIENT -S server.tmp old.tmp >new.tmp
+    expect 'unbini server' "$(cmp ini.tmp new.tmp && echo same)" same
+    expect 'unbini server invalid' \
+        "$(diagnose $CLIENT -S server.tmp ini.tmp)" \
+        '1:unbini: unknown input format (bad magic): 0x6f6f475b'
+    kill $server
+fi
+
+# Test watch mode, where the system has inotify: saved files convert as
+# plain conversions do, and a broken one is reported without ending it.
+# Saving again until an output appears covers the watch's startup.
+rm -rf watch.tmp
+mkdir watch.tmp
+$BINI -w watch.tmp >watched.tmp 2>err.tmp &
+watcher=$!
+for i in 1 2 3 4 5; do
+    kill -0 $watcher 2>/dev/null || break
+    cp ini.tmp watch.tmp/good.txt.ini
+    sleep 1
+    [ -f watch.tmp/good.ini ] && break
+done
+if kill -0 $watcher 2>/dev/null; then
+    expect 'bini watch' "$(cmp old.tmp watch.tmp/good.ini && echo same)" same
+    cp invalid/000.ini watch.tmp/bad.txt.ini
+    sleep 1
+    expect 'bini watch invalid' "$(cat err.tmp)" \
+        'watch.tmp/bad.txt.ini:4: invalid NUL byte'
+    expect 'bini watch survives' "$(kill -0 $watcher && echo alive)" alive
+    expect 'bini watch listing' "$(sort -u watched.tmp)" watch.tmp/good.ini
+    kill $watcher
+fi
+
+# Test incremental conversion: an edit that keeps the same strings only
+# parses its own section, while a new string rebuilds everything
+rm -f sidecar.tmp
+printf '[A]\nk = a, 1\n\n[B]\nk = b, 2\n\n[C]\nk = c, 3\n' >edit.tmp
+$BINI -i sidecar.tmp edit.tmp >/dev/null
+for edit in 'b, 20:2' 'bb, 2:0'; do
+    printf '[A]\nk = a, 1\n\n[B]\nk = %s\n\n[C]\nk = c, 3\n' \
+        "${edit%:*}" >edit.tmp
+    expect "incremental reuse after '${edit%:*}'" \
+        "$($BINI -s -i sidecar.tmp edit.tmp 2>&1 >new.tmp |
+           grep ^sections_reused)" "sections_reused=${edit#*:}"
+    expect "incremental output after '${edit%:*}'" \
+        "$($BINI edit.tmp | cmp - new.tmp && echo same)" same
+done
+
+# Test the trie's concurrent mode, where triestress was built with threads
+if [ -x ./triestress ]; then
+    expect 'concurrent trie' "$(diagnose $RUN ./triestress)" 0:
+fi
+
+rm -f arc.tmp col.tmp edit.tmp err.tmp grep.tmp ini.tmp new.tmp old.tmp \
+    patch.tmp query.tmp server.tmp sidecar.tmp stats.tmp watched.tmp
+rm -rf cache.tmp watch.tmp
+
 # Print report
 if [ $fail -eq 0 ]; then
     printf '\033[1;92mPASS\033[0m'
@@ -0,0 +1,64 @@
+#!/bin/sh -e
+
+# Trace output checks, for builds with -DBINI_TRACE
+#
+# Conversions, checks, and round trips by both tools append to a single
+# trace, which must then hold one well-formed event object per line
+# after the opening bracket, with every span closed in the order it was
+# opened by the process that opened it.
+
+BINI="$RUN ./bini-trace"
+UNBINI="$RUN ./unbini-trace"
+
+rm -f trace.tmp
+for ini in valid/*; do
+    $BINI -T trace.tmp $ini >bini.tmp
+    $UNBINI -T trace.tmp bini.tmp >/dev/null
+done
+$BINI -c -T trace.tmp valid/* invalid/* 2>/dev/null || true
+$BINI -r -T trace.tmp valid/*
+$UNBINI -c -T trace.tmp bini.tmp valid/* 2>/dev/null || true
+
+STRING='"([^"\\]|\\.)*"'
+export EVENT
+EVENT="^\{\"name\":$STRING,\"cat\":\"(file|phase)\",\"ph\":\"[BE]\",\
+\"ts\":[0-9]+\.[0-9]+,\"pid\":[0-9]+,\"tid\":[0-9]+\
+(,\"args\":\{\"[a-z_]+\":-?[0-9.e+-]+\})?\},$"
+
+status=0
+awk '
+    NR == 1 {
+        if ($0 != "[") { print "missing opening bracket"; exit 1 }
+        next
+    }
+    $0 !~ ENVIRON["EVENT"] { print NR ": malformed event: " $0; bad = 1; next }
+    {
+        match($0, /"pid":[0-9]+/)
+        pid = substr($0, RSTART + 6, RLENGTH - 6)
+        name = $0
+        sub(/^\{"name":/, "", name)
+        sub(/,"cat":.*/, "", name)
+        if ($0 ~ /"ph":"B"/) {
+            stack[pid, ++depth[pid]] = name
+        } else if (!depth[pid] || stack[pid, depth[pid]--] != name) {
+            print NR ": unmatched end of " name; bad = 1
+        }
+        events++
+    }
+    END {
+        if (bad || NR == 1)
+            exit 1
+        for (pid in depth)
+            if (depth[pid]) { print "unclosed span in " pid; exit 1 }
+        if (events < 2) { print "no events"; exit 1 }
+    }
+' trace.tmp 1>&2 || status=$?
+
+rm -f bini.tmp trace.tmp
+
+if [ $status -eq 0 ]; then
+    printf '\033[1;92mPASS\033[0m: trace\n'
+else
+    printf '\033[1;91mFAIL\033[0m: trace\n'
+fi
+exit $status
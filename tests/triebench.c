@@ -0,0 +1,283 @@
+/* Microbenchmark for trie.h over the strings of a text INI file
+ *
+ * usage: triebench NAME FILE
+ *
+ * Collects the section names, keys, and string values of FILE,
+ * reversed as the BINI writer interns them, and prints one row: the
+ * number of distinct keys, the memory the trie allocates for them, and
+ * the time per key to insert them all, to search for every occurrence,
+ * and to visit them all. Another implementation with the same interface can
+ * be measured by compiling with -DTRIE_IMPL='"path/to/trie.h"'.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Count the trie's allocations. The standard headers are already in,
+ * so these only affect the implementation included below.
+ */
+static size_t allocated;
+
+union header {
+    size_t size;
+    void *p;
+    double d;
+};
+
+static void *
+counted_malloc(size_t size)
+{
+    union header *h = malloc(sizeof(*h) + size);
+    if (!h)
+        return 0;
+    h->size = size;
+    allocated += size;
+    return h + 1;
+}
+
+static void
+counted_free(void *p)
+{
+    if (p) {
+        union header *h = (union header *)p - 1;
+        allocated -= h->size;
+        free(h);
+    }
+}
+
+static void *
+counted_realloc(void *p, size_t size)
+{
+    union header *h;
+    if (!p)
+        return counted_malloc(size);
+    h = realloc((union header *)p - 1, sizeof(*h) + size);
+    if (!h)
+        return 0;
+    allocated += size - h->size;
+    h->size = size;
+    return h + 1;
+}
+
+#define malloc(n)     counted_malloc(n)
+#define realloc(p, n) counted_realloc(p, n)
+#define free(p)       counted_free(p)
+
+#ifndef TRIE_IMPL
+#  define TRIE_IMPL "../trie.h"
+#endif
+#include TRIE_IMPL
+
+#undef malloc
+#undef realloc
+#undef free
+
+#define MIN_SECONDS 0.2
+
+static char **tokens;
+static long ntokens;
+static char **keys;
+static long nkeys;
+
+static void
+push(char ***list, long *n, char *s)
+{
+    if (!(*n & (*n - 1))) {
+        *list = realloc(*list, (*n ? *n * 2 : 1) * sizeof(**list));
+        if (!*list) {
+            fputs("triebench: out of memory\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    (*list)[(*n)++] = s;
+}
+
+static void
+reverse(char *s)
+{
+    size_t i, len = strlen(s);
+    for (i = 0; i < len / 2; i++) {
+        char tmp = s[i];
+        s[i] = s[len - i - 1];
+        s[len - i - 1] = tmp;
+    }
+}
+
+/* Numbers are encoded as values, not interned. */
+static int
+numeric(const char *s)
+{
+    char *end;
+    strtod(s, &end);
+    return !*end;
+}
+
+/* Split the text in place at brackets, '=', ',' and newlines, trimming
+ * the surrounding whitespace. Quotes are not interpreted, which is
+ * close enough for a key set.
+ */
+static void
+tokenize(char *p)
+{
+    while (*p) {
+        char *end;
+        while (*p == ' ' || *p == '\t' || strchr("[]=,\r\n", *p))
+            if (*p++ == 0)
+                return;
+        if (!*p)
+            return;
+        end = p + strcspn(p, "[]=,\r\n");
+        if (*end)
+            *end++ = 0;
+        else
+            end = 0;
+        {
+            size_t len = strlen(p);
+            while (len && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+                p[--len] = 0;
+        }
+        if (*p && !numeric(p)) {
+            reverse(p);
+            push(&tokens, &ntokens, p);
+        }
+        if (!end)
+            return;
+        p = end;
+    }
+}
+
+static struct trie *
+build(void)
+{
+    long i;
+    struct trie *t = trie_create();
+    if (!t)
+        return 0;
+    for (i = 0; i < nkeys; i++)
+        if (trie_insert(t, keys[i], keys[i]))
+            return 0;
+    return t;
+}
+
+static int
+count_visit(const char *key, void *data, void *arg, int nchildren)
+{
+    (void)key;
+    (void)data;
+    (void)nchildren;
+    ++*(long *)arg;
+    return 0;
+}
+
+static double
+elapsed(clock_t start)
+{
+    return (clock() - start) / (double)CLOCKS_PER_SEC;
+}
+
+int
+main(int argc, char **argv)
+{
+    long i, n, found = 0;
+    size_t memory;
+    double t, insert, search, visit;
+    char *buf;
+    long len;
+    clock_t start;
+    FILE *f;
+    struct trie *trie;
+
+    if (argc != 3) {
+        fputs("usage: triebench NAME FILE\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    f = fopen(argv[2], "rb");
+    if (!f || fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0) {
+        fprintf(stderr, "triebench: cannot read %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+    rewind(f);
+    buf = malloc(len + 1);
+    if (!buf || fread(buf, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "triebench: cannot read %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+    buf[len] = 0;
+    fclose(f);
+    tokenize(buf);
+
+    /* Distinct keys in order of first occurrence */
+    trie = trie_create();
+    for (i = 0; trie && i < ntokens; i++) {
+        if (!trie_search(trie, tokens[i])) {
+            push(&keys, &nkeys, tokens[i]);
+            if (trie_insert(trie, tokens[i], tokens[i]))
+                trie = 0;
+        }
+    }
+    if (!trie) {
+        fputs("triebench: out of memory\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    trie_free(trie);
+    if (!nkeys) {
+        fprintf(stderr, "triebench: no strings in %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Insert */
+    n = 0;
+    insert = 0;
+    memory = 0;
+    do {
+        start = clock();
+        trie = build();
+        insert += elapsed(start);
+        if (!trie) {
+            fputs("triebench: out of memory\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        memory = allocated;
+        trie_free(trie);
+        n++;
+    } while (insert < MIN_SECONDS);
+    insert /= n * (double)nkeys;
+
+    /* Search every occurrence */
+    trie = build();
+    n = 0;
+    start = clock();
+    do {
+        for (i = 0; i < ntokens; i++)
+            found += trie_search(trie, tokens[i]) != 0;
+        n++;
+    } while ((t = elapsed(start)) < MIN_SECONDS);
+    search = t / (n * (double)ntokens);
+    if (found != n * ntokens) {
+        fputs("triebench: search failed\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Visit */
+    n = 0;
+    found = 0;
+    start = clock();
+    do {
+        trie_visit(trie, "", count_visit, &found);
+        n++;
+    } while ((t = elapsed(start)) < MIN_SECONDS);
+    visit = t / (n * (double)nkeys);
+    if (found != n * nkeys) {
+        fputs("triebench: visit failed\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    trie_free(trie);
+
+    printf("%-16s %8ld %10.1f %10.1f %10.1f %10.1f\n", argv[1], nkeys,
+           memory / 1024.0, insert * 1e9, search * 1e9, visit * 1e9);
+    free(keys);
+    free(tokens);
+    free(buf);
+    return 0;
+}
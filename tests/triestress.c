@@ -0,0 +1,202 @@
+/* Concurrent reader and writer test for trie.h in TRIE_CONCURRENT mode
+ *
+ * usage: triestress
+ *
+ * One writer inserts a set of keys while several readers search for
+ * the keys inserted so far, for keys that are never inserted, and visit
+ * prefixes of them, checking every result. Then, with a reader held
+ * inside a call and after it returns, it checks that superseded nodes
+ * wait for that reader and are reused afterwards rather than kept
+ * until trie_free(). Prints nothing and exits successfully if all is
+ * well.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef TRIE_CONCURRENT
+#  define TRIE_CONCURRENT
+#endif
+#include "../trie.h"
+
+#define NKEYS    20000
+#define NREADERS 4
+#define KEYLEN   12
+#define NEXTRA   (NKEYS / 10)
+
+static char keys[NKEYS][KEYLEN];
+static long values[NKEYS];
+static struct trie *trie;
+static long published;  /* keys inserted so far */
+static long failures;
+
+static void
+fail(const char *what, const char *key)
+{
+    fprintf(stderr, "triestress: %s: %s\n", what, key);
+    __atomic_add_fetch(&failures, 1, __ATOMIC_SEQ_CST);
+}
+
+static unsigned long
+xorshift(unsigned long *s)
+{
+    *s ^= (*s << 13) & 0xffffffffUL;
+    *s ^= *s >> 17;
+    *s ^= (*s << 5) & 0xffffffffUL;
+    return *s;
+}
+
+/* Keys over a small alphabet share long prefixes, so inserts split
+ * edges and grow child arrays at every depth.
+ */
+static void
+generate(void)
+{
+    long i;
+    unsigned long s = 0x2545f491UL;
+    for (i = 0; i < NKEYS; i++) {
+        int j, len = 1 + (int)(xorshift(&s) % (KEYLEN - 2));
+        for (j = 0; j < len; j++)
+            keys[i][j] = "abcdefgh"[xorshift(&s) % 8];
+        keys[i][len] = 0;
+        values[i] = -1;
+    }
+}
+
+struct order {
+    char last[KEYLEN];
+    long count;
+};
+
+static int
+check_visit(const char *key, void *data, void *arg, int nchildren)
+{
+    struct order *o = arg;
+    long i = (long *)data - values;
+    size_t n;
+    (void)nchildren;
+    if (i < 0 || i >= NKEYS || strncmp(keys[i], key, n = strlen(keys[i])) ||
+        (key[n] && strcmp(key + n, "x") && strcmp(key + n, "y")))
+        fail("visited wrong data", key);
+    else if (o->count && strcmp(o->last, key) >= 0)
+        fail("visited out of order", key);
+    else
+        strcpy(o->last, key);
+    o->count++;
+    return 0;
+}
+
+/* Insert the first NEXTRA keys again with SUFFIX.
+ * @return the most superseded nodes waiting after any insert from the
+ * second on
+ */
+static size_t
+extend(const char *suffix)
+{
+    long i;
+    size_t retired, most = 0;
+    for (i = 0; i < NEXTRA; i++) {
+        char key[KEYLEN + 1];
+        sprintf(key, "%s%s", keys[i], suffix);
+        if (trie_insert(trie, key, values + values[i])) {
+            fputs("triestress: out of memory\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        retired = trie->limbo[0].fill + trie->limbo[1].fill;
+        if (i && retired > most)
+            most = retired;
+    }
+    return most;
+}
+
+static void *
+reader(void *arg)
+{
+    unsigned long s = 1 + (unsigned long)(size_t)arg;
+    for (;;) {
+        long i, n = __atomic_load_n(&published, __ATOMIC_ACQUIRE);
+        char absent[KEYLEN + 1];
+        long *data;
+        struct order o;
+        if (n == NKEYS)
+            return 0;
+        if (!n)
+            continue;
+        i = (long)(xorshift(&s) % n);
+        data = trie_search(trie, keys[i]);
+        if (!data || strcmp(keys[*data], keys[i]))
+            fail("search missed", keys[i]);
+        sprintf(absent, "%sz", keys[i]);
+        if (trie_search(trie, absent))
+            fail("search found", absent);
+        if (!(xorshift(&s) % 64)) {
+            char prefix[3];
+            o.count = 0;
+            memcpy(prefix, keys[i], 2);
+            prefix[2] = 0;
+            if (trie_visit(trie, prefix, check_visit, &o) || !o.count)
+                fail("visit missed", prefix);
+        }
+    }
+}
+
+int
+main(void)
+{
+    long i;
+    int parity;
+    size_t held, most;
+    pthread_t threads[NREADERS];
+    struct order o;
+
+    generate();
+    trie = trie_create();
+    if (!trie) {
+        fputs("triestress: out of memory\n", stderr);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < NREADERS; i++)
+        if (pthread_create(threads + i, 0, reader, (void *)(size_t)i)) {
+            fputs("triestress: cannot create thread\n", stderr);
+            return EXIT_FAILURE;
+        }
+
+    for (i = 0; i < NKEYS; i++) {
+        long *first = trie_search(trie, keys[i]);
+        values[i] = first ? *first : i;  /* repeated keys keep theirs */
+        if (trie_insert(trie, keys[i], values + values[i])) {
+            fputs("triestress: out of memory\n", stderr);
+            return EXIT_FAILURE;
+        }
+        __atomic_store_n(&published, i + 1, __ATOMIC_RELEASE);
+    }
+    for (i = 0; i < NREADERS; i++)
+        pthread_join(threads[i], 0);
+
+    /* Each new key retires at least the node it is added to, and at
+     * most two nodes, whose reuse must wait for a reader still inside
+     * a call, but no longer.
+     */
+    parity = trie_enter(trie);
+    held = extend("x");
+    trie_leave(trie, parity);
+    most = extend("y");
+    if (held < NEXTRA / 2 || most > 4) {
+        fprintf(stderr, "triestress: %lu and %lu superseded nodes kept\n",
+                (unsigned long)held, (unsigned long)most);
+        failures++;
+    }
+
+    o.count = 0;
+    if (trie_visit(trie, "", check_visit, &o))
+        fail("visit failed", "");
+    for (i = 0; i < NKEYS; i++)
+        if (values[i] == i)
+            o.count -= i < NEXTRA ? 3 : 1;
+    if (o.count)
+        fail("visit count wrong", "");
+    trie_free(trie);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
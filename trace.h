@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Trace-event output for -T, compiled in by defining BINI_TRACE
+ *
+ * Spans are written as begin and end events in the Chrome trace-event
+ * JSON array format, which trace viewers such as Perfetto and
+ * chrome://tracing load directly. Each input file gets a span named
+ * after it, with its size attached, and each phase of its conversion a
+ * span nested inside.
+ *
+ * The file is opened for appending and every event is written as one
+ * flushed line, so that any number of processes converting in parallel
+ * can share a trace, each event tagged with its own process. The
+ * format's closing bracket is optional and never written. Timestamps
+ * come from the monotonic clock, so spans from separate processes line
+ * up on one timeline.
+ *
+ * Without BINI_TRACE the macros expand to nothing, so spans cost
+ * nothing in ordinary builds. Tracing needs POSIX for getpid() and the
+ * monotonic clock. Requires common.h for fatal() and stats.h for the
+ * clock.
+ */
+
+#ifdef BINI_TRACE
+#  if !defined(__unix__) && !defined(__APPLE__)
+#    error BINI_TRACE requires a POSIX system
+#  endif
+
+#  include <errno.h>
+#  include <stdio.h>
+#  include <string.h>
+#  include <unistd.h>
+
+static FILE *trace_file;
+
+static void
+trace_open(const char *path)
+{
+    trace_file = fopen(path, "a");
+    if (!trace_file)
+        fatal("%s: %s", strerror(errno), path);
+    fseek(trace_file, 0, SEEK_END);
+    if (!ftell(trace_file))
+        fputs("[\n", trace_file);
+    fflush(trace_file);
+}
+
+static void
+trace_string(const char *s)
+{
+    fputc('"', trace_file);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(trace_file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(trace_file, "\\u%04x", c);
+        else
+            fputc(c, trace_file);
+    }
+    fputc('"', trace_file);
+}
+
+/* Write one event of phase PH, 'B' or 'E', with an argument if KEY is
+ * not null.
+ */
+static void
+trace_event(int ph, const char *cat, const char *name, const char *key,
+            double value)
+{
+    long pid;
+    if (!trace_file)
+        return;
+    pid = (long)getpid();
+    fputs("{\"name\":", trace_file);
+    trace_string(name);
+    fprintf(trace_file, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+            "\"pid\":%ld,\"tid\":%ld", cat, ph, stats_now() * 1e6, pid, pid);
+    if (key)
+        fprintf(trace_file, ",\"args\":{\"%s\":%.15g}", key, value);
+    fputs("},\n", trace_file);
+    fflush(trace_file);
+}
+
+#  define TRACE_BEGIN(phase)     trace_event('B', "phase", phase, 0, 0)
+#  define TRACE_END(phase)       trace_event('E', "phase", phase, 0, 0)
+#  define TRACE_END_ARG(phase, k, v) \
+                                 trace_event('E', "phase", phase, k, v)
+#  define TRACE_FILE_BEGIN(path) trace_event('B', "file", path, 0, 0)
+#  define TRACE_FILE_END(path, size) \
+                                 trace_event('E', "file", path, "bytes", size)
+#else
+#  define TRACE_BEGIN(phase)
+#  define TRACE_END(phase)
+#  define TRACE_END_ARG(phase, k, v)
+#  define TRACE_FILE_BEGIN(path)
+#  define TRACE_FILE_END(path, size)
+#endif
+
+#endif
@@ -9,12 +9,30 @@
  * be used to visit keys by a string prefix. An empty prefix ""
  * matches all keys (the prefix argument should never be NULL).
  *
- * Internally it uses flexible array members, which is why C99 is
- * required, and is why the initialization function returns a pointer
- * rather than fills a provided struct.
+ * Internally it is path-compressed: each edge is labeled with a run
+ * of characters rather than a single character, and is only split
+ * where keys diverge. Nodes, labels, and child arrays are carved from
+ * large blocks owned by the trie. Since nothing is freed before
+ * trie_free(), which releases the blocks wholesale, this costs no
+ * per-allocation overhead.
  *
  * Except for trie_free(), memory is never freed by the trie, even
  * when entries are "removed" by associating a NULL pointer.
+ *
+ * Defining TRIE_CONCURRENT makes trie_search() and trie_visit() safe
+ * to call from any number of threads while one thread at a time
+ * inserts, without readers taking any lock. Writers must still be
+ * serialized by the caller. Instead of changing a node in place, an
+ * insert builds a modified copy and publishes it with a single atomic
+ * pointer store, so a reader sees each node either entirely before or
+ * entirely after the change. Each reader counts itself in the current
+ * epoch for the length of its call, and the writer reuses a superseded
+ * node only once no reader that might still hold it remains, so a
+ * long-lived trie keeps only a few inserts' worth of old nodes beyond
+ * its live ones. A visitor therefore must not insert, and a visit that
+ * never returns stops reuse. This needs the GCC or Clang atomic
+ * builtins, and inserts are slower than in the default mode, since each
+ * one copies the node and the child array it changes.
  */
 
 #include <stddef.h>
@@ -71,21 +89,146 @@ int trie_visit(struct trie *, const char *prefix, trie_visitor v, void *arg);
 #include <stdlib.h>
 #include <string.h>
 
-struct trieptr {
-    struct trie *trie;
-    int c;
-};
+#ifdef TRIE_CONCURRENT
+#  ifndef __GNUC__
+#    error TRIE_CONCURRENT requires GCC or Clang atomic builtins
+#  endif
+#  define TRIE_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#  define TRIE_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#  define TRIE_LOAD(x)     (x)
+#  define TRIE_STORE(x, v) ((x) = (v))
+#endif
 
-struct trie {
+/* Each node holds the label of the edge leading to it. Children are
+ * kept sorted by the first character of their label, which is also
+ * stored in a byte array just past the child pointers so that a lookup
+ * need not touch the children themselves.
+ */
+struct trie_node {
     void *data;
+    const char *label;            /* not null-terminated */
+    struct trie_node **children;  /* followed by first characters */
+    size_t len;
     unsigned char nchildren, size;
-    struct trieptr children[1];
 };
 
+struct trie_block {
+    struct trie_block *next;
+};
+
+struct trie_retired {
+    struct trie_node *node;
+    int children;  /* whether NODE's child array is also unused */
+};
+
+struct trie_limbo {
+    struct trie_retired *list;
+    size_t fill, size;
+};
+
+struct trie {
+    struct trie_node *root;
+    struct trie_block *blocks;
+    char *lo, *hi;  /* free space in the current block */
+    size_t blocksize;
+    struct trie_node **spare[9];  /* outgrown child arrays by size */
+#ifdef TRIE_CONCURRENT
+    struct trie_node *spare_nodes;
+    unsigned long epoch;
+    unsigned long readers[2];     /* by epoch parity */
+    struct trie_limbo limbo[2];   /* superseded nodes by epoch parity */
+#endif
+};
+
+/* Pool allocator
+ *
+ * Aligned objects are taken from the bottom of the current block and
+ * labels from the top, so labels need no padding. Blocks start small
+ * and double up to a limit, so small tries stay small. Large requests
+ * get a block of their own, leaving the current block in place.
+ */
+
+#define TRIE_BLOCK_MIN 1024
+#define TRIE_BLOCK_MAX 65536
+
+union trie_align {
+    void *p;
+    size_t z;
+    long l;
+    double d;
+};
+
+static void *
+trie_alloc(struct trie *t, size_t n, int aligned)
+{
+    char *p;
+    size_t align = sizeof(union trie_align);
+    if (aligned)
+        n = (n + align - 1) / align * align;
+    if ((size_t)(t->hi - t->lo) < n) {
+        size_t size = n > t->blocksize / 4 ? n : t->blocksize;
+        struct trie_block *b = malloc(align + size);
+        if (!b)
+            return 0;
+        p = (char *)b + align;
+        if (size != t->blocksize) {
+            b->next = t->blocks ? t->blocks->next : 0;
+            if (t->blocks)
+                t->blocks->next = b;
+            else
+                t->blocks = b;
+            return p;
+        }
+        b->next = t->blocks;
+        t->blocks = b;
+        t->lo = p;
+        t->hi = p + size;
+        if (t->blocksize < TRIE_BLOCK_MAX)
+            t->blocksize *= 2;
+    }
+    if (aligned) {
+        p = t->lo;
+        t->lo += n;
+    } else {
+        t->hi -= n;
+        p = t->hi;
+    }
+    return p;
+}
+
+static struct trie_node *
+trie_node_create(struct trie *t)
+{
+    struct trie_node *node;
+#ifdef TRIE_CONCURRENT
+    node = t->spare_nodes;
+    if (node)
+        t->spare_nodes = node->data;
+    else
+#endif
+        node = trie_alloc(t, sizeof(*node), 1);
+    if (node) {
+        node->data = 0;
+        node->label = 0;
+        node->children = 0;
+        node->len = 0;
+        node->nchildren = 0;
+        node->size = 0;
+    }
+    return node;
+}
+
+static char *
+trie_first(const struct trie_node *self)
+{
+    return (char *)(self->children + self->size);
+}
+
 /* Mini stack library for non-recursive traversal. */
 
 struct trie_stack_node {
-    struct trie *trie;
+    struct trie_node *node;
     unsigned char i;
 };
 
@@ -125,10 +268,10 @@ trie_stack_grow(struct trie_stack *s)
 }
 
 static int
-trie_stack_push(struct trie_stack *s, struct trie *trie)
+trie_stack_push(struct trie_stack *s, struct trie_node *node)
 {
     struct trie_stack_node empty = {0, 0};
-    empty.trie = trie;
+    empty.node = node;
     if (s->fill == s->size)
         if (trie_stack_grow(s) != 0)
             return -1;
@@ -136,10 +279,10 @@ trie_stack_push(struct trie_stack *s, struct trie *trie)
     return 0;
 }
 
-static struct trie *
+static struct trie_node *
 trie_stack_pop(struct trie_stack *s)
 {
-    return s->stack[--s->fill].trie;
+    return s->stack[--s->fill].node;
 }
 
 static struct trie_stack_node *
@@ -153,139 +296,291 @@ stack_peek(struct trie_stack *s)
 struct trie *
 trie_create(void)
 {
-    /* Root never needs to be resized. */
-    size_t tail_size = sizeof(struct trieptr) * 254;
-    struct trie *root = malloc(sizeof(*root) + tail_size);
-    if (!root)
+    int i;
+    struct trie *t = malloc(sizeof(*t));
+    if (!t)
+        return 0;
+    t->blocks = 0;
+    t->lo = t->hi = 0;
+    t->blocksize = TRIE_BLOCK_MIN;
+    for (i = 0; i < 9; i++)
+        t->spare[i] = 0;
+#ifdef TRIE_CONCURRENT
+    t->spare_nodes = 0;
+    t->epoch = 0;
+    for (i = 0; i < 2; i++) {
+        t->readers[i] = 0;
+        t->limbo[i].list = 0;
+        t->limbo[i].fill = t->limbo[i].size = 0;
+    }
+#endif
+    t->root = trie_node_create(t);
+    if (!t->root) {
+        free(t);
         return 0;
-    root->size = 255;
-    root->nchildren = 0;
-    root->data = 0;
-    return root;
+    }
+    return t;
 }
 
 int
-trie_free(struct trie *trie)
+trie_free(struct trie *t)
 {
-    struct trie_stack stack, *s = &stack;
-    if (trie_stack_init(s) != 0)
-        return 1;
-    trie_stack_push(s, trie); /* first push always successful */
-    while (s->fill > 0) {
-        struct trie_stack_node *node = stack_peek(s);
-        if (node->i < node->trie->nchildren) {
-            int i = node->i++;
-            if (trie_stack_push(s, node->trie->children[i].trie) != 0)
-                return 1;
-        } else {
-            free(trie_stack_pop(s));
-        }
+#ifdef TRIE_CONCURRENT
+    free(t->limbo[0].list);
+    free(t->limbo[1].list);
+#endif
+    while (t->blocks) {
+        struct trie_block *dead = t->blocks;
+        t->blocks = dead->next;
+        free(dead);
     }
-    trie_stack_free(s);
+    free(t);
     return 0;
 }
 
+/* Epochs
+ *
+ * A reader counts itself under the parity of the epoch it entered,
+ * checking afterwards that the epoch did not move meanwhile. The writer
+ * retires each node it unlinks to the list of the current epoch, and
+ * advances the epoch whenever no reader from the previous one remains.
+ * Readers are then all in the last two epochs, so the nodes retired two
+ * epochs back are unreachable and can be reused.
+ */
+
+#ifdef TRIE_CONCURRENT
+static int
+trie_enter(const struct trie *t)
+{
+    unsigned long *readers = ((struct trie *)t)->readers;
+    for (;;) {
+        unsigned long e = __atomic_load_n(&t->epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(readers + (e & 1), 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&t->epoch, __ATOMIC_SEQ_CST) == e)
+            return (int)(e & 1);
+        __atomic_sub_fetch(readers + (e & 1), 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void
+trie_leave(const struct trie *t, int parity)
+{
+    unsigned long *readers = ((struct trie *)t)->readers;
+    __atomic_sub_fetch(readers + parity, 1, __ATOMIC_RELEASE);
+}
+#else
+#  define trie_enter(t)         0
+#  define trie_leave(t, parity) ((void)(parity))
+#endif
+
 /* Core search functions. */
 
-static size_t
-trie_binary_search(struct trie *self, struct trie **child,
-                   struct trieptr **ptr, const char *key)
-{
-    size_t i = 0;
-    int found = 1;
-    *ptr = 0;
-    while (found && key[i] != '\0') {
-        int first = 0;
-        int last = self->nchildren - 1;
-        int middle;
-        found = 0;
-        while (first <= last) {
-            struct trieptr *p;
-            middle = (first + last) / 2;
-            p = &self->children[middle];
-            if (p->c < key[i]) {
-                first = middle + 1;
-            } else if (p->c == key[i]) {
-                self = p->trie;
-                *ptr = p;
-                found = 1;
-                i++;
-                break;
-            } else {
-                last = middle - 1;
+/* Find the child whose label starts with C, or return -1 and store
+ * where such a child would be inserted.
+ */
+static int
+trie_binary_search(const struct trie_node *self, int c, int *insert)
+{
+    const char *first = trie_first(self);
+    int lo = 0;
+    int hi = self->nchildren - 1;
+    while (lo <= hi) {
+        int middle = (lo + hi) / 2;
+        if (first[middle] < c) {
+            lo = middle + 1;
+        } else if (first[middle] == c) {
+            return middle;
+        } else {
+            hi = middle - 1;
+        }
+    }
+    *insert = lo;
+    return -1;
+}
+
+/* Find the node reached by following KEY. The key may end partway
+ * along that node's label, in which case the number of remaining label
+ * characters is stored in REST.
+ * @return the node, NULL if no key begins with KEY
+ */
+static struct trie_node *
+trie_walk(const struct trie *t, const char *key, size_t *rest)
+{
+    int insert;
+    struct trie_node *self = TRIE_LOAD(t->root);
+    *rest = 0;
+    while (*key) {
+        size_t m;
+        int i = trie_binary_search(self, *key, &insert);
+        if (i < 0)
+            return 0;
+        self = TRIE_LOAD(self->children[i]);
+        for (m = 1; m < self->len; m++) {
+            if (!key[m]) {
+                *rest = self->len - m;
+                return self;
             }
+            if (key[m] != self->label[m])
+                return 0;
         }
+        key += m;
     }
-    *child = self;
-    return i;
+    return self;
 }
 
 void *
-trie_search(const struct trie *self, const char *key)
+trie_search(const struct trie *t, const char *key)
 {
-    struct trie *child;
-    struct trieptr *parent;
-    struct trie *wself = (struct trie *)self;
-    size_t depth = trie_binary_search(wself, &child, &parent, key);
-    return key[depth] == '\0' ? child->data : 0;
+    size_t rest;
+    int parity = trie_enter(t);
+    struct trie_node *node = trie_walk(t, key, &rest);
+    void *data = node && !rest ? TRIE_LOAD(node->data) : 0;
+    trie_leave(t, parity);
+    return data;
 }
 
 /* Insertion functions. */
 
-static struct trie *
-trie_grow1(struct trie *self) {
-    int size;
-    struct trie *resized;
-    size_t children_size;
-    
-    size = self->size * 2;
+/* Spare list for child arrays of SIZE. */
+static struct trie_node ***
+trie_spare(struct trie *t, int size)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+        if (size == 1 << i)
+            return t->spare + i;
+    return t->spare + 8;
+}
+
+static void
+trie_release(struct trie *t, struct trie_node **children, int size)
+{
+    struct trie_node ***spare = trie_spare(t, size);
+    children[0] = (struct trie_node *)*spare;
+    *spare = children;
+}
+
+/* Move the children of SELF to a new array with room for one more.
+ * The old array is kept for reuse by a node of its size, unless SHARED
+ * with another node, as with a concurrent-mode copy.
+ */
+static int
+trie_regrow(struct trie *t, struct trie_node *self, int shared)
+{
+    int size = 1;
+    struct trie_node **children, ***spare;
+    while (size <= self->nchildren)
+        size *= 2;
     if (size > 255)
         size = 255;
-    children_size = sizeof(struct trieptr) * (size) - 1;
-    resized = realloc(self, sizeof(*self) + children_size);
-    if (!resized)
-        return 0;
-    resized->size = (unsigned char)size;
-    return resized;
+    spare = trie_spare(t, size);
+    if (*spare) {
+        children = *spare;
+        *spare = (struct trie_node **)children[0];
+    } else {
+        children = trie_alloc(t, size * (sizeof(*children) + 1), 1);
+        if (!children)
+            return 1;
+    }
+    if (self->nchildren) {
+        memcpy(children, self->children,
+               self->nchildren * sizeof(*children));
+        memcpy(children + size, trie_first(self), self->nchildren);
+    }
+    if (self->size && !shared)
+        trie_release(t, self->children, self->size);
+    self->children = children;
+    self->size = (unsigned char)size;
+    return 0;
 }
 
+/* Make room for one more child. */
 static int
-trie_ptr_cmp(const void *a, const void *b)
+trie_reserve(struct trie *t, struct trie_node *self)
 {
-    return ((struct trieptr *)a)->c - ((struct trieptr *)b)->c;
+    return self->nchildren < self->size ? 0 : trie_regrow(t, self, 0);
 }
 
-static struct trie *
-trie_add1(struct trie *self, int c, struct trie *child)
+/* Insert a child at position I, after trie_reserve(). */
+static void
+trie_add1(struct trie_node *self, int i, struct trie_node *child)
 {
-    int i;
-    if (self->size == self->nchildren) {
-        self = trie_grow1(self);
-        if (!self)
-            return 0;
-    }
-    i = self->nchildren++;
-    self->children[i].c = c;
-    self->children[i].trie = child;
-    qsort(self->children, self->nchildren,
-          sizeof(self->children[0]), trie_ptr_cmp);
-    return self;
+    char *first = trie_first(self);
+    int n = self->nchildren - i;
+    memmove(self->children + i + 1, self->children + i,
+            n * sizeof(*self->children));
+    memmove(first + i + 1, first + i, n);
+    self->children[i] = child;
+    first[i] = child->label[0];
+    self->nchildren++;
 }
 
-static struct trie *
-trie_create1(void)
+/* Prepare a node for modification, making room for another child if
+ * GROW. In concurrent mode this is a copy, which replaces the original
+ * once complete, and which gets its own child array if it grows.
+ * Otherwise the node is modified in place.
+ */
+static struct trie_node *
+trie_modify(struct trie *t, struct trie_node *self, int grow)
 {
-    int size = 1;
-    size_t children_size = sizeof(struct trieptr) * (size - 1);
-    struct trie *trie = malloc(sizeof(*trie) + children_size);
-    if (!trie)
+#ifdef TRIE_CONCURRENT
+    struct trie_node *copy = trie_node_create(t);
+    if (!copy)
         return 0;
-    trie->size = (unsigned char)size;
-    trie->nchildren = 0;
-    trie->data = 0;
-    return trie;
+    *copy = *self;
+    return grow && trie_regrow(t, copy, 1) ? 0 : copy;
+#else
+    return grow && trie_reserve(t, self) ? 0 : self;
+#endif
+}
+
+#ifdef TRIE_CONCURRENT
+/* Retire NODE, superseded by a copy, and its CHILDREN array unless the
+ * copy shares it.
+ */
+static int
+trie_retire(struct trie *t, struct trie_node *node, int children)
+{
+    struct trie_limbo *l = t->limbo + (t->epoch & 1);
+    if (l->fill == l->size) {
+        size_t size = l->size ? l->size * 2 : 16;
+        struct trie_retired *resize;
+        resize = realloc(l->list, size * sizeof(*l->list));
+        if (!resize)
+            return 1;
+        l->list = resize;
+        l->size = size;
+    }
+    l->list[l->fill].node = node;
+    l->list[l->fill].children = children;
+    l->fill++;
+    return 0;
 }
 
+/* Advance the epoch if possible, reusing the nodes retired two back. */
+static void
+trie_reclaim(struct trie *t)
+{
+    unsigned long e = t->epoch;
+    struct trie_limbo *l = t->limbo + ((e + 1) & 1);
+    if (!t->limbo[0].fill && !t->limbo[1].fill)
+        return;
+    if (__atomic_load_n(t->readers + ((e + 1) & 1), __ATOMIC_SEQ_CST))
+        return;
+    __atomic_store_n(&t->epoch, e + 1, __ATOMIC_SEQ_CST);
+    while (l->fill) {
+        struct trie_retired *r = l->list + --l->fill;
+        if (r->children && r->node->size)
+            trie_release(t, r->node->children, r->node->size);
+        r->node->data = t->spare_nodes;
+        t->spare_nodes = r->node;
+    }
+}
+#else
+#  define trie_retire(t, node, children) 0
+#  define trie_reclaim(t)
+#endif
+
 static void *
 trie_identity1(const char *key, void *data, void *arg)
 {
@@ -295,29 +590,62 @@ trie_identity1(const char *key, void *data, void *arg)
 }
 
 int
-trie_replace(struct trie *self, const char *key, trie_replacer f, void *arg)
-{
-    struct trie *last;
-    struct trieptr *parent;
-    size_t depth = trie_binary_search(self, &last, &parent, key);
-    while (key[depth] != '\0') {
-        struct trie *subtrie, *added;
-        subtrie = trie_create1();
-        if (!subtrie)
-            return 1;
-        added = trie_add1(last, key[depth], subtrie);
-        if (!added) {
-            free(subtrie);
-            return 1;
+trie_replace(struct trie *t, const char *key, trie_replacer f, void *arg)
+{
+    const char *p = key;
+    struct trie_node **slot = &t->root;
+    struct trie_node *self = t->root;
+    while (*p) {
+        size_t m;
+        int insert;
+        struct trie_node *child;
+        int i = trie_binary_search(self, *p, &insert);
+
+        if (i < 0) {
+            /* New leaf holding the rest of the key */
+            size_t len = strlen(p);
+            char *label;
+            struct trie_node *parent = trie_modify(t, self, 1);
+            child = trie_node_create(t);
+            label = trie_alloc(t, len, 0);
+            if (!parent || !child || !label)
+                return 1;
+            if (parent != self && trie_retire(t, self, 1))
+                return 1;
+            memcpy(label, p, len);
+            child->label = label;
+            child->len = len;
+            trie_add1(parent, insert, child);
+            if (parent != self)
+                TRIE_STORE(*slot, parent);
+            self = child;
+            break;
         }
-        if (parent) {
-            parent->trie = added;
-            parent = 0;
+
+        child = self->children[i];
+        for (m = 1; m < child->len && p[m] == child->label[m]; m++);
+        if (m < child->len) {
+            /* Split the edge where the key diverges */
+            struct trie_node *split = trie_node_create(t);
+            struct trie_node *tail = trie_modify(t, child, 0);
+            if (!split || !tail || trie_reserve(t, split))
+                return 1;
+            if (tail != child && trie_retire(t, child, 0))
+                return 1;
+            split->label = child->label;
+            split->len = m;
+            tail->label += m;
+            tail->len -= m;
+            trie_add1(split, 0, tail);
+            TRIE_STORE(self->children[i], split);
+            child = split;
         }
-        last = subtrie;
-        depth++;
+        slot = &self->children[i];
+        self = child;
+        p += m;
     }
-    last->data = f(key, last->data, arg);
+    TRIE_STORE(self->data, f(key, self->data, arg));
+    trie_reclaim(t);
     return 0;
 }
 
@@ -335,13 +663,13 @@ struct trie_buffer {
 };
 
 static int
-trie_buffer_init(struct trie_buffer *b, const char *prefix)
+trie_buffer_init(struct trie_buffer *b)
 {
-    b->fill = strlen(prefix);
-    b->size = b->fill >= 256 ? b->fill * 2 : 256;
+    b->fill = 0;
+    b->size = 256;
     b->buffer = malloc(b->size);
     if (b->buffer)
-        memcpy(b->buffer, prefix, b->fill + 1);
+        b->buffer[0] = '\0';
     return b->buffer ? 0 : -1;
 }
 
@@ -353,94 +681,90 @@ trie_buffer_free(struct trie_buffer *b)
 }
 
 static int
-trie_buffer_grow(struct trie_buffer *b)
-{
-    char *resize = realloc(b->buffer, b->size * 2);
-    if (!resize) {
-        trie_buffer_free(b);
-        return -1;
-    }
-    b->buffer = resize;
-    b->size *= 2;
-    return 0;
-}
-
-static int
-trie_buffer_push(struct trie_buffer *b, int c)
+trie_buffer_push(struct trie_buffer *b, const char *s, size_t len)
 {
-    if (b->fill + 1 == b->size)
-        if (trie_buffer_grow(b) != 0)
+    while (b->fill + len >= b->size) {
+        char *resize = realloc(b->buffer, b->size * 2);
+        if (!resize) {
+            trie_buffer_free(b);
             return -1;
-    b->buffer[b->fill++] = (char)c;
+        }
+        b->buffer = resize;
+        b->size *= 2;
+    }
+    memcpy(b->buffer + b->fill, s, len);
+    b->fill += len;
     b->buffer[b->fill] = '\0';
     return 0;
 }
 
 static void
-trie_buffer_pop(struct trie_buffer *b)
+trie_buffer_pop(struct trie_buffer *b, size_t len)
 {
-    if (b->fill > 0)
-        b->buffer[--b->fill] = '\0';
+    b->fill -= len;
+    b->buffer[b->fill] = '\0';
 }
 
 /* Core visitation functions. */
 
+/* Visit SELF and its descendants, B holding the key of SELF. */
 static int
-visit(struct trie *self, const char *prefix, trie_visitor visitor, void *arg)
+visit(struct trie_node *self, struct trie_buffer *b,
+      trie_visitor visitor, void *arg)
 {
-    struct trie_buffer buffer, *b = &buffer;
     struct trie_stack stack, *s = &stack;
-    if (trie_buffer_init(b, prefix) != 0)
-        return -1;
-    if (trie_stack_init(s) != 0) {
-        trie_buffer_free(b);
+    if (trie_stack_init(s) != 0)
         return -1;
-    }
     trie_stack_push(s, self);
     while (s->fill > 0) {
         struct trie_stack_node *node = stack_peek(s);
-        if (node->i == 0 && node->trie->data) {
-            void *data = node->trie->data;
-            int nchildren = node->trie->nchildren;
+        void *data = node->i ? 0 : TRIE_LOAD(node->node->data);
+        if (data) {
+            int nchildren = node->node->nchildren;
             int r = visitor(b->buffer, data, arg, nchildren);
             if (r != 0) {
-                trie_buffer_free(b);
                 trie_stack_free(s);
                 return 1;
             }
         }
-        if (node->i < node->trie->nchildren) {
-            struct trie *trie = node->trie->children[node->i].trie;
-            int c = node->trie->children[node->i].c;
+        if (node->i < node->node->nchildren) {
+            struct trie_node *child;
+            child = TRIE_LOAD(node->node->children[node->i]);
             node->i++;
-            if (trie_stack_push(s, trie) != 0) {
-                trie_buffer_free(b);
+            if (trie_stack_push(s, child) != 0)
                 return -1;
-            }
-            if (trie_buffer_push(b, c) != 0) {
+            if (trie_buffer_push(b, child->label, child->len) != 0) {
                 trie_stack_free(s);
                 return -1;
             }
         } else {
-            trie_buffer_pop(b);
-            trie_stack_pop(s);
+            struct trie_node *done = trie_stack_pop(s);
+            if (s->fill > 0)
+                trie_buffer_pop(b, done->len);
         }
     }
-    trie_buffer_free(b);
     trie_stack_free(s);
     return 0;
 }
 
 int
-trie_visit(struct trie *self, const char *prefix, trie_visitor f, void *arg)
+trie_visit(struct trie *t, const char *prefix, trie_visitor f, void *arg)
 {
-    int r;
-    struct trie *start = self;
-    struct trieptr *ptr;
-    size_t depth = trie_binary_search(self, &start, &ptr, prefix);
-    if (prefix[depth] != '\0')
-        return 0;
-    r = visit(start, prefix, f, arg);
+    int r = 0, parity = trie_enter(t);
+    size_t rest;
+    struct trie_buffer buffer, *b = &buffer;
+    struct trie_node *start = trie_walk(t, prefix, &rest);
+    if (start) {
+        const char *tail = start->label + start->len - rest;
+        if (trie_buffer_init(b) != 0 ||
+            trie_buffer_push(b, prefix, strlen(prefix)) != 0 ||
+            (rest && trie_buffer_push(b, tail, rest) != 0))
+            r = -1;
+        else
+            r = visit(start, b, f, arg);
+        trie_buffer_free(b);
+    }
+    trie_leave(t, parity);
     return r >= 0 ? 0 : -1;
 }
 
@@ -1,164 +1,374 @@
 #define __USE_MINGW_ANSI_STDIO 1
+#if defined(__unix__) || defined(__APPLE__)
+#  define _POSIX_C_SOURCE 200112L  /* for server mode */
+#endif
 #include <errno.h>
 #include <stdio.h>
-#include <stdint.h> /* Only for uint32_t */
 #include <stdlib.h>
 #include <string.h>
 
 #define PROGRAM_NAME "unbini"
 
 #include "common.h"
+#include "format.h"
 #include "getopt.h"
+#include "cache.h"   /* after getopt.h, for unistd.h */
+#include "reader.h"
+#include "stats.h"
+#include "trace.h"
+#if defined(__unix__) || defined(__APPLE__)
+#  include "server.h"
+#endif
 
-static unsigned long
-parse_u32(const unsigned char *p)
+static void
+usage(FILE *f)
 {
-    return (unsigned long)p[0] <<  0 |
-           (unsigned long)p[1] <<  8 |
-           (unsigned long)p[2] << 16 |
-           (unsigned long)p[3] << 24;
+    fprintf(f, "usage: " PROGRAM_NAME " [-ms] [-C dir] [-o path] [-q query] [-T path] [<BINI|BINI]\n");
+    fprintf(f, "       " PROGRAM_NAME " -c [-T path] [BINI...]\n");
+    fprintf(f, "       " PROGRAM_NAME " -S socket\n");
+    fprintf(f, "  -c       only check inputs for errors, writing no output\n");
+    fprintf(f, "  -C dir   reuse and record outputs in a cache directory\n");
+    fprintf(f, "  -h       print this message\n");
+    fprintf(f, "  -m       compact output, for reading back with bini\n");
+    fprintf(f, "  -o path  output to a file (default: standard output)\n");
+    fprintf(f, "  -q query only print SECTION or SECTION/KEY (repeatable)\n");
+    fprintf(f, "  -s       print conversion statistics to standard error\n");
+    fprintf(f, "  -S path  serve conversions on a Unix domain socket\n");
+    fprintf(f, "  -T path  append trace events to a file\n");
+    fprintf(f, "  -V       print version information\n");
 }
 
-static unsigned
-parse_u16(const unsigned char *p)
-{
-    return (unsigned)p[0] <<  0 |
-           (unsigned)p[1] <<  8;
-}
+/* Statistics for -s
+ *
+ * Counts cover the whole input, whatever the queries select. The
+ * string metrics match bini's: the distinct strings referenced, those
+ * referenced as the suffix of another stored string, and how far the
+ * last stored string starts below the largest offset.
+ */
 
-static long
-conv_s32(unsigned long x)
-{
-    if (x & 0x80000000UL) /* Sign extend? */
-        return x | ~0xffffffffUL;
-    return x;
-}
+static struct {
+    double start, read, format, write;
+    unsigned long sections, entries, values[4];
+    int counting;         /* for -s only, while -T just needs the laps */
+    int cache_hit;        /* nothing was converted, so nothing counted */
+    unsigned char *refs;  /* string table offsets referenced */
+    struct reader r;      /* the converted input */
+} stats;
 
-static float
-conv_f32(unsigned long x)
+static void
+stats_entry(struct reader *r, unsigned name, int nvalue,
+            const unsigned char *values)
 {
-    union {
-        uint32_t i;
-        float f;
-    } conv;
-    conv.i = x;
-    return conv.f;
+    int j;
+    stats.entries++;
+    stats.refs[name] = 1;
+    for (j = 0; j < nvalue; j++) {
+        unsigned long val;
+        int type = reader_value(r, values + j * 5, &val);
+        if (type < 0)
+            return;
+        stats.values[type]++;
+        if (type == VALUE_STRING)
+            stats.refs[val] = 1;
+    }
 }
 
-/* Print a string, potentially quoted/escaped.
- *
- * If S contains any character from SPECIAL, it will be quoted. If
- * SPECIAL is a null pointer, always printed it quoted.
- */
 static void
-print_special(const unsigned char *s, char *special, FILE *out)
+stats_report(unsigned long inlen)
 {
-    int simple = *s != 0 && special && !strpbrk((char *)s, special);
-    if (simple) {
-        fputs((char *)s, out);
-    } else {
-        fputc('"', out);
-        for (; *s; s++) {
-            if (*s == '"')
-                fputc('"', out);
-            fputc(*s, out);
+    unsigned long i, last = 0;
+    unsigned long strings = 0, shared = 0, saved = 0;
+    const struct reader *r = &stats.r;
+    for (i = 0; stats.refs && i < r->textlen; i++) {
+        int start = !i || !r->text[i - 1];
+        if (start)
+            last = i;
+        if (stats.refs[i]) {
+            strings++;
+            if (!start) {
+                shared++;
+                saved += (unsigned long)strlen((char *)r->text + i) + 1;
+            }
         }
-        fputc('"', out);
     }
+    stats_count("input_bytes", inlen);
+    stats_time("read", stats.read);
+    stats_time("format", stats.format);
+    stats_time("write", stats.write);
+    stats_time("total", stats_now() - stats.start);
+    stats_memory();
+    if (stats.cache_hit) {
+        stats_count("cache_hit", 1);
+        return;
+    }
+    stats_count("sections", stats.sections);
+    stats_count("entries", stats.entries);
+    stats_count("values_integer", stats.values[VALUE_INTEGER]);
+    stats_count("values_float", stats.values[VALUE_FLOAT]);
+    stats_count("values_string", stats.values[VALUE_STRING]);
+    stats_count("strings_unique", strings);
+    stats_count("strings_shared", shared);
+    stats_count("strings_saved_bytes", saved);
+    stats_count("string_table_bytes", r->textlen);
+    stats_count("string_table_headroom", last > 65535 ? 0 : 65535 - last);
+    free(stats.refs);
 }
 
-static void
-print_section_name(const unsigned char *s, FILE *out)
+/* Parse a SECTION or SECTION/KEY query, destroying the argument.
+ */
+static struct query *
+query_create(char *arg)
 {
-    fputc('[', out);
-    print_special(s, "\"[] \f\n\r\t\v", out);
-    fputs("]\n", out);
+    struct query *q = xmalloc(sizeof(*q));
+    if (query_parse(q, arg))
+        fatal("invalid query");
+    if (q->index >= 0)
+        fatal("queries cannot select a value index");
+    return q;
 }
 
-static void
-print_entry_name(const unsigned char *s, FILE *out)
+/* Is any entry in the section possibly selected by a query?
+ */
+static int
+select_section(struct query **q, int n, const unsigned char *text,
+               unsigned section)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        if (matcher_test(&q[i]->section, text, section))
+            return 1;
+    return !n;
+}
+
+/* Is the entry selected by a query? A negative KEY asks about the
+ * section as a whole, which is selected only by section-only queries.
+ */
+static int
+select_entry(struct query **q, int n, const unsigned char *text,
+             unsigned section, long key)
 {
-    print_special(s, "\"=[] \f\n\r\t\v", out);
-    fputs(" =", out);
+    int i;
+    for (i = 0; i < n; i++) {
+        if (!matcher_test(&q[i]->section, text, section))
+            continue;
+        if (key < 0 ? !q[i]->key.name
+                    : matcher_test(&q[i]->key, text, (unsigned)key))
+            return 1;
+    }
+    return !n;
 }
 
+/* Print a BINI buffer as INI, restricted to the selected entries,
+ * compact if COMPACT is non-zero.
+ */
 static void
-print_string(const unsigned char *s, FILE *out)
+convert(unsigned char *buf, unsigned long len, struct query **queries,
+        int nquery, int compact, FILE *out)
 {
-    long i;
-    double f;
-    char *end;
-
-    /* Does it look like a float? Quote it. */
-    errno = 0;
-    f = strtod((char *)s, &end);
-    if ((f != 0 || !errno) && *end == 0) {
-        print_special(s, 0, out);
-        return;
+    int i, printed = 0;
+    int e, nvalue;
+    unsigned section_name, nentry, name;
+    const unsigned char *values;
+    struct reader r;
+
+    if (reader_init(&r, buf, len))
+        fatal("%s", r.err);
+    for (i = 0; i < nquery; i++)
+        if (matcher_reset(&queries[i]->section, r.textlen) ||
+            matcher_reset(&queries[i]->key, r.textlen))
+            fatal("out of memory");
+    if (stats.counting) {
+        stats.refs = xmalloc(r.textlen + 1);
+        memset(stats.refs, 0, r.textlen + 1);
     }
+    TRACE_BEGIN("format");
 
-    /* Does it look an integer? Quote it. */
-    errno = 0;
-    i = strtol((char *)s, &end, 10);
-    if ((i != 0 || !errno) && *end == 0) {
-        print_special(s, 0, out);
-        return;
+    /* Parse each section */
+    while ((e = reader_section(&r, &section_name, &nentry)) == 1) {
+        int header = 0;
+        int selected = select_section(queries, nquery, r.text, section_name);
+
+        if (stats.counting) {
+            stats.sections++;
+            stats.refs[section_name] = 1;
+        }
+
+        /* Print each entry */
+        while ((e = reader_entry(&r, &name, &nvalue, &values)) == 1) {
+            if (stats.counting)
+                stats_entry(&r, name, nvalue, values);
+
+            /* Unselected entries are skipped without any formatting */
+            if (!selected ||
+                !select_entry(queries, nquery, r.text, section_name, name))
+                continue;
+
+            /* Print section name just before its first entry */
+            if (!header) {
+                print_section(r.text + section_name, compact, printed, out);
+                header = printed = 1;
+            }
+            if (print_entry(&r, name, nvalue, values, compact, out))
+                fatal("%s", r.err);
+        }
+        if (e < 0)
+            break;
+
+        /* Sections without printed entries may still be selected */
+        if (!header && selected &&
+            select_entry(queries, nquery, r.text, section_name, -1)) {
+            print_section(r.text + section_name, compact, printed, out);
+            printed = 1;
+        }
+    }
+    if (e < 0)
+        fatal("%s", r.err);
+
+    /* Pointer *should* now be exactly at the text segment */
+    if (r.p != r.text) {
+        int c = (int)(r.text - r.p);
+        fprintf(stderr, "warning: %d garbage byte%s before text segment\n",
+                c, c == 1 ? "" : "s");
     }
 
-    /* Print it as a string, maybe quoting it. */
-    print_special(s, "\", \f\n\r\t\v", out);
+    TRACE_END("format");
+    TRACE_BEGIN("write");
+    if (stats_enabled) {
+        stats_lap(&stats.format);
+        fflush(out);
+        stats_lap(&stats.write);
+        stats.r = r;
+    }
+    TRACE_END("write");
 }
 
-/* Print the simplest form that parses identically with strtod().
+/* Validate one input buffer without formatting anything, reporting the
+ * same diagnostics as a conversion. Returns non-zero if invalid.
  */
-static void
-print_minfloat(float f, FILE *out)
+static int
+check(const unsigned char *buf, unsigned long len)
 {
-    int i;
-    int bestlen;
-    char best[32];
-
-    /* Assume %#.9g is valid and start with it as the best */
-    bestlen = sprintf(best, "%#.9g", f);
-
-    /* Try to find something shorter */
-    for (i = 8; i > 0; i--) {
-        char buf[sizeof(best)];
-        int len = sprintf(buf, "%#.*g", i, f);
-        if (f == (float)strtod(buf, 0)) {
-            /* It's valid, but is it shorter? */
-            if (len < bestlen) {
-                bestlen = len;
-                memcpy(best, buf, sizeof(buf));
+    int e, nvalue;
+    unsigned section_name, nentry, name;
+    const unsigned char *values;
+    struct reader r;
+
+    if (!reader_init(&r, buf, len)) {
+        while ((e = reader_section(&r, &section_name, &nentry)) == 1) {
+            while ((e = reader_entry(&r, &name, &nvalue, &values)) == 1) {
+                int j;
+                unsigned long val;
+                for (j = 0; j < nvalue && e > 0; j++)
+                    if (reader_value(&r, values + j * 5, &val) < 0)
+                        e = -1;
+                if (e < 0)
+                    break;
             }
-        } else {
-            /* Precision is now being lost, bailout */
-            break;
+            if (e < 0)
+                break;
         }
+        if (!e && r.p != r.text) {
+            int c = (int)(r.text - r.p);
+            fprintf(stderr, "warning: %d garbage byte%s before text "
+                    "segment\n", c, c == 1 ? "" : "s");
+        }
+    } else {
+        e = -1;
     }
-    fwrite(best, bestlen, 1, out);
+
+    if (e < 0)
+        fprintf(stderr, PROGRAM_NAME ": %s\n", r.err);
+    return e;
 }
 
+/* Read and validate one input. FILENAME only names its trace span.
+ */
+static int
+check_file(FILE *in, const char *filename)
+{
+    int r;
+    unsigned long len;
+    unsigned char *buf;
+    (void)filename;
+    TRACE_FILE_BEGIN(filename);
+    TRACE_BEGIN("read");
+    buf = slurp(in, &len);
+    TRACE_END("read");
+    TRACE_BEGIN("validate");
+    r = check(buf, len);
+    TRACE_END("validate");
+    TRACE_FILE_END(filename, len);
+    free(buf);
+    return r;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/* Convert one request in server mode.
+ */
+static void
+convert_request(const char *name, char *buf, unsigned long len, FILE *out)
+{
+    (void)name;
+    convert((unsigned char *)buf, len, 0, 0, 0, out);
+}
+#endif
+
 int
 main(int argc, char **argv)
 {
     int option;
     FILE *in = stdin;
     FILE *out = stdout;
-    unsigned long len, textlen;
-    unsigned long bini, vers, textoff;
-    unsigned char *buf, *text, *p;
-
-    while ((option = getopt(argc, argv, "ho:V")) != -1) {
+    unsigned long len;
+    unsigned char *buf;
+    int i, nquery = 0;
+    struct query **queries = 0;
+    FILE *final = 0;
+    char *cachedir = 0;
+    char *socketpath = 0;
+    char *tracepath = 0;
+    int checkonly = 0;
+    int compact = 0;
+    int showstats = 0;
+    char *cachepath = 0;
+    char *salt = xmalloc(1);
+
+    *salt = 0;
+    while ((option = getopt(argc, argv, "cC:hmo:q:sS:T:V")) != -1) {
         switch (option) {
+            case 'c':
+                checkonly = 1;
+                break;
+            case 'C':
+                cachedir = optarg;
+                break;
             case 'h':
                 usage(stdout);
                 exit(EXIT_SUCCESS);
+            case 'm':
+                compact = 1;
+                break;
             case 'o':
                 out = fopen(optarg, "wb");
                 if (!out)
                     fatal("%s: %s", strerror(errno), optarg);
                 break;
+            case 'q':
+                /* Queries change the output, so they salt the cache key */
+                salt = xreallocarray(salt, strlen(salt) + strlen(optarg) + 2, 1);
+                strcat(strcat(salt, optarg), "\n");
+                queries = xreallocarray(queries, nquery + 1, sizeof(*queries));
+                queries[nquery++] = query_create(optarg);
+                break;
+            case 's':
+                showstats = 1;
+                break;
+            case 'S':
+                socketpath = optarg;
+                break;
+            case 'T':
+                tracepath = optarg;
+                break;
             case 'V':
                 version();
                 exit(EXIT_SUCCESS);
@@ -168,6 +378,54 @@ main(int argc, char **argv)
         }
     }
 
+    /* Compact output salts the cache key too. Query salts always end
+     * in a newline, so this cannot be mistaken for one.
+     */
+    if (compact) {
+        salt = xreallocarray(salt, strlen(salt) + 3, 1);
+        strcat(salt, "-m");
+    }
+
+    /* Output is flushed at the end of formatting for the trace as it
+     * is for statistics, so that the write span shows the final write.
+     */
+    if (tracepath) {
+#ifdef BINI_TRACE
+        trace_open(tracepath);
+        stats_start();
+#else
+        fatal("tracing requires building with -DBINI_TRACE");
+#endif
+    }
+
+    if (checkonly) {
+        int failed = 0;
+        if (!argv[optind])
+            exit(check_file(stdin, "stdin") ? EXIT_FAILURE : EXIT_SUCCESS);
+        for (i = optind; i < argc; i++) {
+            in = fopen(argv[i], "rb");
+            if (!in) {
+                fprintf(stderr, PROGRAM_NAME ": %s: %s\n",
+                        strerror(errno), argv[i]);
+                failed = 1;
+                continue;
+            }
+            failed |= !!check_file(in, argv[i]);
+            fclose(in);
+        }
+        exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if (socketpath) {
+#if defined(__unix__) || defined(__APPLE__)
+        if (argv[optind] || nquery)
+            fatal("server mode takes no queries or input arguments");
+        serve(socketpath, convert_request);
+#else
+        fatal("server mode is only supported on POSIX systems");
+#endif
+    }
+
     if (argv[optind]) {
         /* Open given filename */
         if (argv[optind + 1])
@@ -187,103 +445,51 @@ main(int argc, char **argv)
     }
 #endif
 
+    if (showstats) {
+        stats_start();
+        stats.start = stats_mark;
+        stats.counting = 1;
+    }
+    TRACE_FILE_BEGIN(argv[optind] ? argv[optind] : "stdin");
+    TRACE_BEGIN("read");
     buf = slurp(in, &len);
-
-    /* Validate the input */
-    if (len < 12)
-        fatal("input is too short: %lu bytes", len);
-    bini    = parse_u32(buf + 0);
-    vers    = parse_u32(buf + 4);
-    textoff = parse_u32(buf + 8);
-    if (bini != 0x494e4942UL)
-        fatal("unknown input format (bad magic): 0x%08lx", bini);
-    if (vers != 0x00000001UL)
-        fatal("unknown input format (bad version): %lu", vers);
-    if (textoff > len)
-        fatal("unknown input format (bad text offset): %lu", textoff);
-    if (textoff < len && buf[len - 1] != 0)
-        fatal("invalid input (unterminated text segment)");
-
-    /* Set up data pointers */
-    p = buf + 12;
-    text = buf + textoff;
-    textlen = len - textoff;
-
-    /* Parse each section */
-    while (p < text - 3) {
-        unsigned i;
-        unsigned section_name = parse_u16(p + 0);
-        unsigned nentry = parse_u16(p + 2);
-
-        /* Print section name */
-        if (section_name >= textlen)
-            fatal("invalid section text offset, aborting");
-        if (p > buf + 12)
-            fputc('\n', out);
-        print_section_name(text + section_name, out);
-
-        /* Print each entry */
-        p += 4;
-        for (i = 0; i < nentry; i++) {
-            int j, nvalue;
-            unsigned name;
-
-            /* is there enough room for this entry? */
-            if (p > text - 3)
-                fatal("truncated entry, aborting");
-
-            /* parse entry struct */
-            name = parse_u16(p);
-            nvalue = p[2];
-            p += 3;
-
-            /* validate entry struct */
-            if (name >= textlen)
-                fatal("invalid entry text offset, aborting");
-            if (nvalue * 5UL > (unsigned long)(text - p))
-                fatal("truncated entry value, aborting");
-
-            /* print each value */
-            print_entry_name(text + name, out);
-            for (j = 0; j < nvalue; j++) {
-                int type = p[j * 5 + 0];
-                unsigned long val = parse_u32(p + j * 5 + 1);
-
-                fputs(j ? ", " : " ", out);
-                switch (type) {
-                    case 1:
-                        fprintf(out, "%ld", conv_s32(val));
-                        break;
-                    case 2:
-                        print_minfloat(conv_f32(val), out);
-                        break;
-                    case 3:
-                        if (val >= textlen)
-                            fatal("invalid value text offset, aborting");
-                        print_string(text + val, out);
-                        break;
-                    default:
-                        fatal("bad value type, %d", type);
-                }
-            }
-            fputc('\n', out);
-
-            p += nvalue * 5;
+    stats_lap(&stats.read);
+    TRACE_END("read");
+    if (cachedir) {
+        cachepath = cache_path(cachedir, salt, buf, len);
+        if (!cache_fetch(cachepath, out)) {
+            final = out;
+            out = tmpfile();
+            if (!out)
+                fatal("%s", strerror(errno));
+        } else {
+            stats.cache_hit = 1;
         }
     }
 
-    /* Pointer *should* now be exactly at the text segment */
-    if (p != text) {
-        int c = (int)(text - p);
-        fprintf(stderr, "warning: %d garbage byte%s before text segment\n",
-                c, c == 1 ? "" : "s");
+    if (!cachedir || final)
+        convert(buf, len, queries, nquery, compact, out);
+    if (final) {
+        cache_store(cachepath, out, final);
+        out = final;
     }
+    TRACE_FILE_END(argv[optind] ? argv[optind] : "stdin", len);
+    if (showstats)
+        stats_report(len);
 
     /* Clean up */
     if (fclose(out))
         fatal("%s", strerror(errno));
     if (in != stdin)
         fclose(in);
+    for (i = 0; i < nquery; i++) {
+        free(queries[i]->section.memo);
+        free(queries[i]->key.memo);
+        free(queries[i]);
+    }
+    free(queries);
+    free(cachepath);
+    free(salt);
     free(buf);
     return 0;
 }
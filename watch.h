@@ -0,0 +1,128 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Directory watching with inotify (Linux only)
+ *
+ * Editors tend to save in bursts of writes, or by writing a temporary
+ * file and renaming it over the original, so changed names are
+ * collected until the directory has been quiet for a moment before
+ * they are handled. Each file is handled in a forked child so that a
+ * conversion error, which exits, only ends that one conversion while
+ * the watching process carries on. Requires common.h, and a definition
+ * of _POSIX_C_SOURCE ahead of all includes.
+ */
+
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define WATCH_QUIET 200  /* milliseconds */
+
+typedef void (*watch_handler)(const char *path);
+
+/* Queue a changed file name, ignoring duplicates.
+ */
+static char **
+watch_queue(char **names, int *n, const char *name)
+{
+    int i;
+    for (i = 0; i < *n; i++)
+        if (!strcmp(names[i], name))
+            return names;
+    names = xreallocarray(names, *n + 1, sizeof(*names));
+    names[*n] = xmalloc(strlen(name) + 1);
+    strcpy(names[(*n)++], name);
+    return names;
+}
+
+/* Handle every queued file in its own child process.
+ */
+static void
+watch_flush(const char *dir, char **names, int n, watch_handler handler)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        int status;
+        pid_t pid;
+        char *path = xmalloc(strlen(dir) + strlen(names[i]) + 2);
+        sprintf(path, "%s/%s", dir, names[i]);
+
+        fflush(stdout);
+        fflush(stderr);
+        pid = fork();
+        if (pid == -1)
+            fatal("fork: %s", strerror(errno));
+        if (!pid) {
+            handler(path);
+            exit(EXIT_SUCCESS);
+        }
+        if (waitpid(pid, &status, 0) == -1)
+            fatal("waitpid: %s", strerror(errno));
+        if (!WIFEXITED(status))
+            fprintf(stderr, PROGRAM_NAME ": %s: conversion crashed\n", path);
+
+        free(path);
+        free(names[i]);
+    }
+}
+
+/* Watch DIR forever, calling HANDLER on each file whose name ends with
+ * SUFFIX once it has been written or moved into place.
+ */
+static void
+watch(const char *dir, const char *suffix, watch_handler handler)
+{
+    union {
+        struct inotify_event event;
+        char buf[1 << 14];
+    } u;
+    char **names = 0;
+    int nname = 0;
+    size_t suffixlen = strlen(suffix);
+    struct pollfd pfd;
+
+    pfd.fd = inotify_init();
+    pfd.events = POLLIN;
+    if (pfd.fd == -1)
+        fatal("inotify: %s", strerror(errno));
+    if (inotify_add_watch(pfd.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+        fatal("%s: %s", strerror(errno), dir);
+
+    for (;;) {
+        char *p;
+        ssize_t len;
+        int r = poll(&pfd, 1, nname ? WATCH_QUIET : -1);
+
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            fatal("poll: %s", strerror(errno));
+        }
+        if (!r) {
+            /* Quiet at last */
+            watch_flush(dir, names, nname, handler);
+            nname = 0;
+            continue;
+        }
+
+        len = read(pfd.fd, u.buf, sizeof(u.buf));
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            fatal("inotify: %s", strerror(errno));
+        }
+        for (p = u.buf; p < u.buf + len; ) {
+            struct inotify_event *e = (struct inotify_event *)p;
+            size_t namelen = e->len ? strlen(e->name) : 0;
+            if (namelen > suffixlen &&
+                !strcmp(e->name + namelen - suffixlen, suffix))
+                names = watch_queue(names, &nname, e->name);
+            p += sizeof(*e) + e->len;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+/* BINI writer: string intern table and packed structure output
+ *
+ * Strings are interned reversed in a trie so that a string which is a
+ * suffix of another is visited just before it. Such suffixes share the
+ * storage of the longer string in the string table. Interned strings
+ * are views, a pointer and a length, usually into the caller's input,
+ * which is never modified. Requires common.h for fatal() and xmalloc().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trie.h"
+
+/* Grow a scratch buffer to hold at least N bytes. */
+static char *
+scratch(char **buf, size_t *cap, size_t n)
+{
+    if (n > *cap) {
+        while (*cap < n)
+            *cap = *cap ? *cap * 2 : 256;
+        *buf = xreallocarray(*buf, *cap, 1);
+    }
+    return *buf;
+}
+
+/* String intern table
+ *
+ * S holds LEN bytes and is only null-terminated if the storage it
+ * views happens to be, as a BINI string table is.
+ */
+
+struct string {
+    const char *s;
+    struct string *parent;
+    long offset;
+    long len;
+};
+
+/* A secondary string ends where the primary string at the top of its
+ * parent chain ends. The whole chain is resolved and remembered at
+ * once, so that each string is only measured once however long the
+ * chain or however often the string is referenced.
+ */
+static long
+string_offset(struct string *s)
+{
+    long end;
+    struct string *top, *p;
+    if (s->offset != -1)
+        return s->offset;
+    for (top = s->parent; top->offset == -1; top = top->parent)
+        ;
+    end = top->offset + top->len;
+    for (p = s; p != top; p = p->parent) {
+        p->offset = end - p->len;
+        if (p->offset > 65535)
+            fatal("too many strings");
+    }
+    return s->offset;
+}
+
+/* Intern the LEN bytes at STR. A new string views STR, which must
+ * outlive the table, unless COPY is set, in which case its bytes are
+ * copied once into the string's own allocation. The reversed trie key
+ * is built in a scratch buffer.
+ */
+static struct string *
+strings_push(struct trie *t, const char *str, size_t len, int copy)
+{
+    static char *buf;
+    static size_t cap;
+    size_t i;
+    struct string *s;
+    char *key = scratch(&buf, &cap, len + 1);
+
+    for (i = 0; i < len; i++)
+        key[i] = str[len - i - 1];
+    key[len] = 0;
+    s = trie_search(t, key);
+    if (!s) {
+        s = xmalloc(sizeof(*s) + (copy ? len + 1 : 0));
+        if (copy) {
+            char *own = (char *)(s + 1);
+            memcpy(own, str, len);
+            own[len] = 0;
+            str = own;
+        }
+        s->s = str;
+        s->parent = 0;
+        s->offset = -1;
+        s->len = (long)len;
+        if (trie_insert(t, key, s))
+            fatal("out of memory");
+    }
+    return s;
+}
+
+/* Child to be connected to next-visited string */
+static struct string *child = 0;
+
+static int
+compute_offset(const char *key, void *data, void *arg, int nsiblings)
+{
+    struct string *s = data;
+    long *offset = arg;
+    (void)key;
+    if (child)
+        child->parent = s;
+    if (nsiblings) {
+        /* Secondary string, connect it to the next visited node */
+        child = s;
+    } else {
+        /* Primary string, append it to the table */
+        if (*offset > 65535)
+            fatal("too many strings");
+        s->offset = *offset;
+        *offset += s->len + 1;
+        child = 0;
+    }
+    return 0;
+}
+
+/* Compute string table offsets. */
+static long
+strings_finalize(struct trie *t)
+{
+    long offset = 0;
+    if (trie_visit(t, "", compute_offset, &offset))
+        fatal("out of memory");
+    return offset;
+}
+
+static int
+free_visitor(const char *key, void *data, void *arg, int nsiblings)
+{
+    (void)key;
+    (void)arg;
+    (void)nsiblings;
+    free(data);
+    return 0;
+}
+
+static void
+strings_free(struct trie *t)
+{
+    trie_visit(t, "", free_visitor, 0);
+    trie_free(t);
+}
+
+static int
+write_visit(const char *key, void *data, void *arg, int nsiblings)
+{
+    FILE *out = arg;
+    struct string *s = data;
+    (void)key;
+    if (!nsiblings) {
+        fwrite(s->s, s->len, 1, out);
+        fputc(0, out);
+    }
+    return 0;
+}
+
+static void
+strings_write(struct trie *t, FILE *out)
+{
+    if (trie_visit(t, "", write_visit, out))
+        fatal("out of memory");
+}
+
+/* BINI structs
+ *
+ * The layout here does *not* much resemble their layout in BINI files.
+ *
+ * Interned strings are views, so unless they were copied the storage
+ * they point into must outlive the table. Integer and float values are
+ * kept as their raw 32-bit patterns so that floats are written back bit
+ * for bit.
+ */
+
+#define VALUE_INTEGER 1
+#define VALUE_FLOAT   2
+#define VALUE_STRING  3
+struct value {
+    struct value *next;
+    union {
+        unsigned long u;
+        struct string *s;
+    } value;
+    int type;
+};
+
+struct entry {
+    struct entry *next;
+    struct string *name;
+    struct value *values;
+    int nvalue;
+};
+
+struct section {
+    struct section *next;
+    struct string *name;
+    struct entry *entries;
+    long nentry;
+    unsigned long size;
+};
+
+static void
+store_u32(unsigned long x, FILE *f)
+{
+    fputc(x >>  0, f);
+    fputc(x >>  8, f);
+    fputc(x >> 16, f);
+    fputc(x >> 24, f);
+}
+
+static void
+store_u16(unsigned x, FILE *f)
+{
+    fputc(x >> 0, f);
+    fputc(x >> 8, f);
+}
+
+/* Write only the packed section, entry, and value structures. The
+ * string table must already be finalized.
+ */
+static void
+sections_write_structs(struct section *sections, FILE *out)
+{
+    struct section *section;
+    for (section = sections; section; section = section->next) {
+        struct entry *entry;
+
+        /* Write section */
+        store_u16(string_offset(section->name), out);
+        store_u16(section->nentry, out);
+
+        for (entry = section->entries; entry; entry = entry->next) {
+            struct value *value;
+
+            /* Write entry */
+            store_u16(string_offset(entry->name), out);
+            fputc(entry->nvalue, out);
+
+            for (value = entry->values; value; value = value->next) {
+                /* Write value */
+                fputc(value->type, out);
+                switch (value->type) {
+                    case VALUE_INTEGER:
+                    case VALUE_FLOAT:
+                        store_u32(value->value.u, out);
+                        break;
+                    case VALUE_STRING:
+                        store_u32(string_offset(value->value.s), out);
+                        break;
+                }
+            }
+        }
+    }
+}
+
+/* Write a complete BINI file, header to string table. The string
+ * table must already be finalized.
+ */
+static void
+sections_write(struct section *sections, struct trie *strings, FILE *out)
+{
+    unsigned long outlen = 12;
+    struct section *section;
+
+    for (section = sections; section; section = section->next)
+        outlen += section->size;
+
+    /* Write bini header */
+    store_u32(0x494e4942UL, out);
+    store_u32(0x00000001UL, out);
+    store_u32(outlen, out);
+
+    sections_write_structs(sections, out);
+    strings_write(strings, out);
+}
+
+static void
+sections_free(struct section *section)
+{
+    while (section) {
+        struct section *sdead = section;
+        struct entry *entry = section->entries;
+        while (entry) {
+            struct entry *edead = entry;
+            struct value *value = entry->values;
+            while (value) {
+                struct value *vdead = value;
+                value = value->next;
+                free(vdead);
+            }
+            entry = entry->next;
+            free(edead);
+        }
+        section = section->next;
+        free(sdead);
+    }
+}
+
+#endif